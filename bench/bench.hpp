@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+// A benchmark body performs `iterations` operations; the harness reports
+// the time per operation.
+using Body = std::function<void(std::size_t iterations)>;
+
+struct Benchmark {
+    std::string name;
+    Body body;
+};
+
+inline std::vector<Benchmark>& registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+struct Registrar {
+    Registrar(const char* name, Body body) {
+        registry().push_back({name, std::move(body)});
+    }
+};
+
+struct Options {
+    std::size_t repetitions = 10;
+    std::chrono::nanoseconds min_sample_time = std::chrono::milliseconds(50);
+    std::string filter;
+};
+
+struct Result {
+    std::string name;
+    std::size_t iterations = 0;
+    std::vector<double> samples;
+};
+
+template<typename T>
+inline void do_not_optimize(T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile auto sink = value;
+    sink = value;
+#endif
+}
+
+inline double time_per_op(const Body& body, std::size_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    body(iterations);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+inline Result run(const Benchmark& benchmark, const Options& options) {
+    // Grow the batch until one sample takes at least min_sample_time, so
+    // clock resolution and loop overhead stay out of the numbers.
+    std::size_t iterations = 1;
+    while (true) {
+        auto ns = time_per_op(benchmark.body, iterations) * iterations;
+        if (ns >= options.min_sample_time.count() || iterations >= (std::size_t(1) << 30)) {
+            break;
+        }
+        auto scale = ns > 0 ? options.min_sample_time.count() / ns : 10.0;
+        iterations = static_cast<std::size_t>(iterations * std::clamp(scale * 1.2, 2.0, 10.0));
+    }
+
+    Result result{benchmark.name, iterations, {}};
+    for (std::size_t i = 0; i < options.repetitions; ++i) {
+        result.samples.push_back(time_per_op(benchmark.body, iterations));
+    }
+    return result;
+}
+
+inline void write_json(std::ostream& out, const std::vector<Result>& results) {
+    out << "{\n  \"unit\": \"ns/op\",\n  \"benchmarks\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto& result = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": \"" << result.name
+            << "\", \"iterations\": " << result.iterations << ", \"samples\": [";
+        for (std::size_t j = 0; j < result.samples.size(); ++j) {
+            out << (j ? ", " : "") << result.samples[j];
+        }
+        out << "]}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+}
+
+#define BENCH_CAT_(a, b) a##b
+#define BENCH_CAT(a, b) BENCH_CAT_(a, b)
+
+#define BENCHMARK(name) \
+    static void BENCH_CAT(bench_, name)(std::size_t iterations); \
+    static ::bench::Registrar BENCH_CAT(bench_registrar_, name)(#name, &BENCH_CAT(bench_, name)); \
+    static void BENCH_CAT(bench_, name)(std::size_t iterations)
@@ -0,0 +1,285 @@
+// Compares two benchmark result files written by promise-cc-bench and
+// reports changes whose 95% confidence interval excludes zero. Exits with
+// status 1 when any benchmark regressed by more than the threshold.
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Just enough JSON to read the result files back: objects, arrays, strings
+// and numbers.
+class Reader {
+public:
+    explicit Reader(std::string text) : _text(std::move(text)) {}
+
+    std::map<std::string, std::vector<double>> results() {
+        std::map<std::string, std::vector<double>> results;
+
+        expect('{');
+        while (!consume('}')) {
+            auto key = string();
+            expect(':');
+            if (key != "benchmarks") {
+                skip();
+            } else {
+                expect('[');
+                while (!consume(']')) {
+                    auto [name, samples] = benchmark();
+                    results[name] = std::move(samples);
+                    consume(',');
+                }
+            }
+            consume(',');
+        }
+        return results;
+    }
+
+private:
+    std::pair<std::string, std::vector<double>> benchmark() {
+        std::string name;
+        std::vector<double> samples;
+
+        expect('{');
+        while (!consume('}')) {
+            auto key = string();
+            expect(':');
+            if (key == "name") {
+                name = string();
+            } else if (key == "samples") {
+                expect('[');
+                while (!consume(']')) {
+                    samples.push_back(number());
+                    consume(',');
+                }
+            } else {
+                skip();
+            }
+            consume(',');
+        }
+        return {name, samples};
+    }
+
+    void whitespace() {
+        while (_pos < _text.size() && std::isspace(static_cast<unsigned char>(_text[_pos]))) {
+            ++_pos;
+        }
+    }
+
+    bool consume(char c) {
+        whitespace();
+        if (_pos < _text.size() && _text[_pos] == c) {
+            ++_pos;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!consume(c)) {
+            throw std::runtime_error(std::string("expected '") + c + "' at offset " + std::to_string(_pos));
+        }
+    }
+
+    std::string string() {
+        expect('"');
+        std::string value;
+        while (_pos < _text.size() && _text[_pos] != '"') {
+            if (_text[_pos] == '\\' && _pos + 1 < _text.size()) {
+                ++_pos;
+            }
+            value += _text[_pos++];
+        }
+        expect('"');
+        return value;
+    }
+
+    double number() {
+        whitespace();
+        std::size_t used = 0;
+        auto value = std::stod(_text.substr(_pos, 64), &used);
+        _pos += used;
+        return value;
+    }
+
+    void skip() {
+        whitespace();
+        if (_pos >= _text.size()) {
+            throw std::runtime_error("unexpected end of input");
+        }
+
+        auto c = _text[_pos];
+        if (c == '"') {
+            string();
+        } else if (c == '{' || c == '[') {
+            auto close = c == '{' ? '}' : ']';
+            ++_pos;
+            while (!consume(close)) {
+                if (c == '{') {
+                    string();
+                    expect(':');
+                }
+                skip();
+                consume(',');
+            }
+        } else if (c == 't' || c == 'f' || c == 'n') {
+            while (_pos < _text.size() && std::isalpha(static_cast<unsigned char>(_text[_pos]))) {
+                ++_pos;
+            }
+        } else {
+            number();
+        }
+    }
+
+    std::string _text;
+    std::size_t _pos = 0;
+};
+
+std::map<std::string, std::vector<double>> load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("cannot open " + path);
+    }
+
+    std::stringstream text;
+    text << file.rdbuf();
+    return Reader(text.str()).results();
+}
+
+struct Summary {
+    double mean = 0;
+    double variance = 0;
+    std::size_t n = 0;
+};
+
+Summary summarize(const std::vector<double>& samples) {
+    Summary summary;
+    summary.n = samples.size();
+    for (auto sample : samples) {
+        summary.mean += sample;
+    }
+    summary.mean /= std::max<std::size_t>(summary.n, 1);
+
+    for (auto sample : samples) {
+        summary.variance += (sample - summary.mean) * (sample - summary.mean);
+    }
+    summary.variance /= std::max<std::size_t>(summary.n, 2) - 1;
+    return summary;
+}
+
+// Two-sided 95% critical value of Student's t distribution.
+double t_critical(double df) {
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+
+    if (!(df >= 1)) {
+        return table[0];
+    }
+    auto index = static_cast<std::size_t>(std::floor(df));
+    if (index <= 30) {
+        return table[index - 1];
+    }
+    return 1.960 + 2.4 / df;
+}
+
+void usage(const char* argv0) {
+    std::cerr << "usage: " << argv0 << " BASELINE.json CURRENT.json [--threshold PERCENT]\n";
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> files;
+    double threshold = 5.0;
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "--threshold" && i + 1 < argc) {
+            threshold = std::stod(argv[++i]);
+        } else if (arg.rfind("--", 0) == 0) {
+            usage(argv[0]);
+            return 2;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    if (files.size() != 2) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::map<std::string, std::vector<double>> baseline, current;
+    try {
+        baseline = load(files[0]);
+        current = load(files[1]);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+
+    int regressions = 0;
+    std::printf("%-28s %14s %14s %9s %21s  %s\n", "benchmark", "baseline ns", "current ns", "change", "95% CI", "verdict");
+
+    for (const auto& [name, samples] : current) {
+        auto it = baseline.find(name);
+        if (it == baseline.end()) {
+            std::printf("%-28s %14s %14.2f %9s %21s  %s\n", name.c_str(), "-", summarize(samples).mean, "-", "-", "new");
+            continue;
+        }
+
+        auto before = summarize(it->second);
+        auto after = summarize(samples);
+
+        // The t-test needs a variance on both sides.
+        if (before.n < 2 || after.n < 2) {
+            auto change = 100.0 * (after.mean - before.mean) / before.mean;
+            std::printf("%-28s %14.2f %14.2f %+8.1f%% %21s  %s\n", name.c_str(), before.mean, after.mean, change, "-", "insufficient samples");
+            continue;
+        }
+
+        // Welch's t-test on the difference of means.
+        auto va = before.variance / before.n;
+        auto vb = after.variance / after.n;
+        auto se = std::sqrt(va + vb);
+        auto df = (va + vb) * (va + vb) / (va * va / (before.n - 1) + vb * vb / (after.n - 1) + 1e-300);
+        auto margin = t_critical(df) * se;
+
+        auto diff = after.mean - before.mean;
+        auto change = 100.0 * diff / before.mean;
+        auto low = 100.0 * (diff - margin) / before.mean;
+        auto high = 100.0 * (diff + margin) / before.mean;
+
+        const char* verdict = "unchanged";
+        if (low > 0) {
+            verdict = change > threshold ? "REGRESSION" : "slower";
+            regressions += change > threshold;
+        } else if (high < 0) {
+            verdict = -change > threshold ? "IMPROVEMENT" : "faster";
+        }
+
+        char ci[64];
+        std::snprintf(ci, sizeof(ci), "[%+.1f%%, %+.1f%%]", low, high);
+        std::printf("%-28s %14.2f %14.2f %+8.1f%% %21s  %s\n", name.c_str(), before.mean, after.mean, change, ci, verdict);
+    }
+
+    for (const auto& [name, samples] : baseline) {
+        if (!current.count(name)) {
+            std::printf("%-28s %14.2f %14s %9s %21s  %s\n", name.c_str(), summarize(samples).mean, "-", "-", "-", "missing");
+        }
+    }
+
+    return regressions ? 1 : 0;
+}
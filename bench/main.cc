@@ -0,0 +1,69 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+
+static void usage(const char* argv0) {
+    std::cerr << "usage: " << argv0 << " [--out FILE] [--repetitions N] [--min-time-ms N] [--filter SUBSTR]\n";
+}
+
+int main(int argc, char** argv) {
+    bench::Options options;
+    std::string out;
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                usage(argv[0]);
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--out") {
+            out = value();
+        } else if (arg == "--repetitions") {
+            options.repetitions = std::stoul(value());
+        } else if (arg == "--min-time-ms") {
+            options.min_sample_time = std::chrono::milliseconds(std::stoul(value()));
+        } else if (arg == "--filter") {
+            options.filter = value();
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<bench::Result> results;
+    for (const auto& benchmark : bench::registry()) {
+        if (!options.filter.empty() && benchmark.name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+
+        results.push_back(bench::run(benchmark, options));
+
+        const auto& samples = results.back().samples;
+        double mean = 0;
+        for (auto sample : samples) {
+            mean += sample;
+        }
+        std::cerr << benchmark.name << ": " << mean / samples.size() << " ns/op\n";
+    }
+
+    if (out.empty()) {
+        bench::write_json(std::cout, results);
+    } else {
+        std::ofstream file(out);
+        bench::write_json(file, results);
+        if (!file) {
+            std::cerr << "failed to write " << out << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
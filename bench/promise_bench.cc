@@ -0,0 +1,150 @@
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <type_traits>
+
+#include <promise/promise.hpp>
+#include <promise/runtime.hpp>
+
+#include "bench.hpp"
+
+using promise::usePromise;
+using promise::useResolve;
+
+namespace {
+
+struct ExecutorInline {
+    template<typename F>
+    inline void operator()(F f) {
+        f();
+    }
+};
+
+struct ExecutorInlineLocal : ExecutorInline {
+    using core_local = std::true_type;
+};
+
+struct ExecutorInlineAligned : ExecutorInline {
+    using cache_aligned = std::true_type;
+};
+
+// One thread resolves promises while the other attaches continuations to
+// them, so settling and attaching contend on the same states.
+template<typename Executor>
+void cross_thread_resolve_attach(std::size_t iterations) {
+    promise::SpscRing<std::function<void(int)>> ring(1024);
+    std::atomic<bool> done{false};
+    std::atomic<std::size_t> completed{0};
+
+    std::thread resolver([&] {
+        std::function<void(int)> resolve;
+        while (true) {
+            if (ring.pop(resolve)) {
+                resolve(1);
+                resolve = nullptr;
+            } else if (done.load(std::memory_order_acquire)) {
+                if (ring.empty()) {
+                    break;
+                }
+            }
+        }
+    });
+
+    for (std::size_t i = 0; i < iterations; ++i) {
+        std::function<void(int)> resolve;
+        auto p = usePromise<int>([&](auto res, auto) {
+            resolve = res;
+        }, Executor());
+
+        while (!ring.push(resolve)) {
+        }
+
+        p.then([&](int v) {
+            completed.fetch_add(v, std::memory_order_relaxed);
+            return v;
+        });
+    }
+
+    done.store(true, std::memory_order_release);
+    resolver.join();
+    bench::do_not_optimize(completed);
+}
+
+template<typename Executor>
+void then_chain_10(std::size_t iterations) {
+    for (std::size_t i = 0; i < iterations; ++i) {
+        int result = 0;
+        auto p = useResolve<int>(static_cast<int>(i), Executor());
+        auto q = p.then([](int v) { return v + 1; })
+            .then([](int v) { return v + 1; })
+            .then([](int v) { return v + 1; })
+            .then([](int v) { return v + 1; })
+            .then([](int v) { return v + 1; })
+            .then([](int v) { return v + 1; })
+            .then([](int v) { return v + 1; })
+            .then([](int v) { return v + 1; })
+            .then([](int v) { return v + 1; })
+            .then([&](int v) { result = v; return true; });
+        bench::do_not_optimize(result);
+    }
+}
+
+}
+
+BENCHMARK(resolve_settled) {
+    for (std::size_t i = 0; i < iterations; ++i) {
+        auto p = useResolve<int>(static_cast<int>(i), ExecutorInline());
+        bench::do_not_optimize(p);
+    }
+}
+
+BENCHMARK(then_chain_10) {
+    then_chain_10<ExecutorInline>(iterations);
+}
+
+BENCHMARK(then_chain_10_core_local) {
+    then_chain_10<ExecutorInlineLocal>(iterations);
+}
+
+BENCHMARK(attach_then_resolve) {
+    for (std::size_t i = 0; i < iterations; ++i) {
+        int result = 0;
+        std::function<void(int)> resolver;
+        usePromise<int>([&](auto resolve, auto) {
+            resolver = resolve;
+        }, ExecutorInline()).then([&](int v) {
+            result = v;
+            return true;
+        });
+        resolver(static_cast<int>(i));
+        bench::do_not_optimize(result);
+    }
+}
+
+BENCHMARK(fan_out_8) {
+    for (std::size_t i = 0; i < iterations; ++i) {
+        int result = 0;
+        std::function<void(int)> resolver;
+        auto p = usePromise<int>([&](auto resolve, auto) {
+            resolver = resolve;
+        }, ExecutorInline());
+        for (int j = 0; j < 8; ++j) {
+            p.then([&](int v) {
+                result += v;
+                return true;
+            });
+        }
+        resolver(static_cast<int>(i));
+        bench::do_not_optimize(result);
+    }
+}
+
+
+BENCHMARK(cross_thread_resolve_attach) {
+    cross_thread_resolve_attach<ExecutorInline>(iterations);
+}
+
+BENCHMARK(cross_thread_resolve_attach_cache_aligned) {
+    cross_thread_resolve_attach<ExecutorInlineAligned>(iterations);
+}
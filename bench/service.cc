@@ -0,0 +1,444 @@
+// End-to-end reference service over loopback TCP. Each request runs through
+// parse -> cache lookup -> fan-out -> aggregate -> serialize as a chain of
+// promises on a worker pool; closed-loop clients measure throughput and
+// latency percentiles.
+//
+// Request:  "GET k1,k2,...\n"
+// Response: "OK <sum>\n"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <promise/executor.hpp>
+#include <promise/promise.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+using promise::PoolExecutor;
+
+template<typename T>
+using Promise = promise::Promise<T, PoolExecutor>;
+
+// Stand-in for a backend call: deterministic, a few microseconds of CPU.
+std::uint64_t backend(std::uint64_t key) {
+    auto h = key * 0x9E3779B97F4A7C15ull;
+    for (int i = 0; i < 512; ++i) {
+        h ^= h >> 29;
+        h *= 0xBF58476D1CE4E5B9ull;
+    }
+    return h % 1000;
+}
+
+class Cache {
+public:
+    std::optional<std::uint64_t> get(std::uint64_t key) {
+        std::lock_guard<std::mutex> lock(_mtx);
+        auto it = _values.find(key);
+        if (it == _values.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    void put(std::uint64_t key, std::uint64_t value) {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_values.size() > 4096) {
+            _values.clear();
+        }
+        _values[key] = value;
+    }
+
+private:
+    std::mutex _mtx;
+    std::unordered_map<std::uint64_t, std::uint64_t> _values;
+};
+
+struct Lookup {
+    std::vector<std::uint64_t> keys;
+    std::vector<std::optional<std::uint64_t>> cached;
+};
+
+// Fan-in of one promise per key into the sum of their values.
+Promise<std::uint64_t> gather(const std::vector<Promise<std::uint64_t>>& parts, PoolExecutor executor) {
+    struct Join {
+        std::mutex mtx;
+        std::size_t remaining;
+        std::uint64_t sum = 0;
+        std::function<void(std::uint64_t)> resolve;
+        std::function<void(std::exception_ptr)> reject;
+        bool settled = false;
+    };
+
+    auto join = std::make_shared<Join>();
+    join->remaining = parts.size();
+
+    auto result = promise::usePromise<std::uint64_t>([join](auto resolve, auto reject) {
+        join->resolve = resolve;
+        join->reject = reject;
+    }, executor);
+
+    if (parts.empty()) {
+        join->resolve(0);
+    }
+
+    for (auto part : parts) {
+        part.then([join](std::uint64_t v) {
+            std::unique_lock<std::mutex> lock(join->mtx);
+            join->sum += v;
+            if (--join->remaining == 0 && !join->settled) {
+                join->settled = true;
+                auto sum = join->sum;
+                lock.unlock();
+                join->resolve(sum);
+            }
+            return true;
+        }, [join](std::exception_ptr e) {
+            std::unique_lock<std::mutex> lock(join->mtx);
+            if (!join->settled) {
+                join->settled = true;
+                lock.unlock();
+                join->reject(e);
+            }
+            return false;
+        });
+    }
+
+    return result;
+}
+
+void send_all(int fd, const std::string& data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+        auto n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return;
+        }
+        sent += n;
+    }
+}
+
+// Reads one '\n'-terminated line, keeping any extra bytes in buffer.
+bool read_line(int fd, std::string& buffer, std::string& line) {
+    while (true) {
+        auto pos = buffer.find('\n');
+        if (pos != std::string::npos) {
+            line = buffer.substr(0, pos);
+            buffer.erase(0, pos + 1);
+            return true;
+        }
+
+        char chunk[4096];
+        auto n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return false;
+        }
+        buffer.append(chunk, n);
+    }
+}
+
+class Server {
+public:
+    Server(std::size_t workers) : _pool(workers) {
+        _listen = ::socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        ::setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        if (::bind(_listen, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(_listen, 128) != 0) {
+            throw std::runtime_error("cannot listen on loopback");
+        }
+
+        socklen_t len = sizeof(addr);
+        ::getsockname(_listen, reinterpret_cast<sockaddr*>(&addr), &len);
+        _port = ntohs(addr.sin_port);
+
+        _acceptor = std::thread([this] { accept_loop(); });
+    }
+
+    ~Server() {
+        _stopping = true;
+        ::shutdown(_listen, SHUT_RDWR);
+        ::close(_listen);
+        _acceptor.join();
+        for (auto& connection : _connections) {
+            connection.join();
+        }
+    }
+
+    std::uint16_t port() const {
+        return _port;
+    }
+
+private:
+    void accept_loop() {
+        while (!_stopping) {
+            int fd = ::accept(_listen, nullptr, nullptr);
+            if (fd < 0) {
+                return;
+            }
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            _connections.emplace_back([this, fd] { serve(fd); });
+        }
+    }
+
+    void serve(int fd) {
+        std::string buffer, line;
+        while (read_line(fd, buffer, line)) {
+            handle(fd, std::move(line));
+        }
+        ::close(fd);
+    }
+
+    // Clients wait for each response before sending the next request, so
+    // the chain's final write never races another one on this socket.
+    void handle(int fd, std::string request) {
+        auto executor = _pool.executor();
+
+        promise::usePromise<std::string>([request = std::move(request)](auto resolve, auto) {
+            resolve(request);
+        }, executor).then([](const std::string& request) {
+            // parse
+            std::vector<std::uint64_t> keys;
+            if (request.rfind("GET ", 0) != 0) {
+                throw std::runtime_error("bad request");
+            }
+            std::stringstream in(request.substr(4));
+            std::string key;
+            while (std::getline(in, key, ',')) {
+                keys.push_back(std::stoull(key));
+            }
+            return keys;
+        }).then([this](const std::vector<std::uint64_t>& keys) {
+            // cache lookup
+            Lookup lookup{keys, {}};
+            for (auto key : keys) {
+                lookup.cached.push_back(_cache.get(key));
+            }
+            return lookup;
+        }).then([this, executor](const Lookup& lookup) {
+            // fan-out to the backend for misses, then aggregate
+            std::vector<Promise<std::uint64_t>> parts;
+            for (std::size_t i = 0; i < lookup.keys.size(); ++i) {
+                if (lookup.cached[i]) {
+                    parts.push_back(promise::useResolve<std::uint64_t>(*lookup.cached[i], executor));
+                } else {
+                    auto key = lookup.keys[i];
+                    parts.push_back(promise::usePromise<std::uint64_t>([this, key](auto resolve, auto) {
+                        auto value = backend(key);
+                        _cache.put(key, value);
+                        resolve(value);
+                    }, executor));
+                }
+            }
+            return gather(parts, executor);
+        }).then([fd](Promise<std::uint64_t> sum) {
+            // serialize
+            sum.then([fd](std::uint64_t total) {
+                send_all(fd, "OK " + std::to_string(total) + "\n");
+                return true;
+            }, [fd](std::exception_ptr) {
+                send_all(fd, "ERR\n");
+                return false;
+            });
+            return true;
+        }, [fd](std::exception_ptr) {
+            send_all(fd, "ERR\n");
+            return false;
+        });
+    }
+
+    promise::ThreadPool _pool;
+    Cache _cache;
+    int _listen = -1;
+    std::uint16_t _port = 0;
+    std::atomic<bool> _stopping{false};
+    std::thread _acceptor;
+    std::vector<std::thread> _connections;
+};
+
+struct Options {
+    std::size_t connections = 8;
+    std::size_t workers = std::max(2u, std::thread::hardware_concurrency());
+    std::size_t keys = 8;
+    std::size_t key_space = 10000;
+    std::chrono::milliseconds duration{2000};
+    std::size_t repetitions = 1;
+    std::string out;
+};
+
+struct RunResult {
+    double seconds = 0;
+    std::vector<double> latencies_us;
+};
+
+RunResult run_clients(std::uint16_t port, const Options& options) {
+    std::vector<std::vector<double>> latencies(options.connections);
+    std::vector<std::thread> clients;
+    std::atomic<bool> stop{false};
+
+    auto start = Clock::now();
+    for (std::size_t c = 0; c < options.connections; ++c) {
+        clients.emplace_back([&, c] {
+            int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(port);
+            if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+                ::close(fd);
+                return;
+            }
+
+            std::mt19937_64 rng(c);
+            std::uniform_int_distribution<std::uint64_t> key(0, options.key_space - 1);
+            std::string buffer, line;
+
+            while (!stop.load(std::memory_order_relaxed)) {
+                std::string request = "GET ";
+                for (std::size_t k = 0; k < options.keys; ++k) {
+                    request += (k ? "," : "") + std::to_string(key(rng));
+                }
+                request += "\n";
+
+                auto sent = Clock::now();
+                send_all(fd, request);
+                if (!read_line(fd, buffer, line)) {
+                    break;
+                }
+                latencies[c].push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+            }
+            ::close(fd);
+        });
+    }
+
+    std::this_thread::sleep_for(options.duration);
+    stop = true;
+    for (auto& client : clients) {
+        client.join();
+    }
+
+    RunResult result;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (auto& l : latencies) {
+        result.latencies_us.insert(result.latencies_us.end(), l.begin(), l.end());
+    }
+    std::sort(result.latencies_us.begin(), result.latencies_us.end());
+    return result;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    auto index = static_cast<std::size_t>(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+void usage(const char* argv0) {
+    std::cerr << "usage: " << argv0
+              << " [--connections N] [--workers N] [--keys N] [--key-space N]"
+                 " [--duration-ms N] [--repetitions N] [--out FILE]\n";
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        auto value = std::string(argv[++i]);
+
+        if (arg == "--connections") {
+            options.connections = std::stoul(value);
+        } else if (arg == "--workers") {
+            options.workers = std::stoul(value);
+        } else if (arg == "--keys") {
+            options.keys = std::stoul(value);
+        } else if (arg == "--key-space") {
+            options.key_space = std::max<std::size_t>(std::stoul(value), 1);
+        } else if (arg == "--duration-ms") {
+            options.duration = std::chrono::milliseconds(std::stoul(value));
+        } else if (arg == "--repetitions") {
+            options.repetitions = std::max<std::size_t>(std::stoul(value), 1);
+        } else if (arg == "--out") {
+            options.out = value;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    Server server(options.workers);
+
+    // Results use the promise-cc-bench schema so promise-cc-bench-compare
+    // can diff them across builds.
+    std::vector<bench::Result> results = {
+        {"service_ns_per_request", 0, {}},
+        {"service_latency_p50_ns", 0, {}},
+        {"service_latency_p99_ns", 0, {}},
+        {"service_latency_p999_ns", 0, {}},
+    };
+
+    for (std::size_t r = 0; r < options.repetitions; ++r) {
+        auto run = run_clients(server.port(), options);
+        auto requests = run.latencies_us.size();
+        auto throughput = requests / run.seconds;
+
+        std::printf(
+            "run %zu: %zu requests, %.0f req/s, latency us p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+            r + 1, requests, throughput,
+            percentile(run.latencies_us, 0.5), percentile(run.latencies_us, 0.9),
+            percentile(run.latencies_us, 0.99), percentile(run.latencies_us, 0.999),
+            run.latencies_us.empty() ? 0.0 : run.latencies_us.back()
+        );
+
+        results[0].iterations += requests;
+        results[0].samples.push_back(requests ? 1e9 / throughput : 0);
+        results[1].samples.push_back(percentile(run.latencies_us, 0.5) * 1e3);
+        results[2].samples.push_back(percentile(run.latencies_us, 0.99) * 1e3);
+        results[3].samples.push_back(percentile(run.latencies_us, 0.999) * 1e3);
+    }
+
+    if (!options.out.empty()) {
+        std::ofstream file(options.out);
+        bench::write_json(file, results);
+    }
+    return 0;
+}
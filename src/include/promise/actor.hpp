@@ -0,0 +1,326 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "promise.hpp"
+
+namespace promise {
+
+namespace internal {
+
+template<typename State>
+struct Message {
+    virtual ~Message() = default;
+    virtual void run(State&) {}
+
+    std::atomic<Message*> next{nullptr};
+};
+
+template<typename State, typename F>
+struct MessageFn : Message<State> {
+    explicit MessageFn(F fn) : fn(std::move(fn)) {}
+
+    void run(State& state) override {
+        fn(state);
+    }
+
+    F fn;
+};
+
+// Intrusive multi-producer single-consumer queue (Vyukov): push is one
+// exchange, pop never blocks producers.
+template<typename State>
+class Mailbox {
+public:
+    Mailbox() : _head(&_stub), _tail(&_stub) {}
+
+    ~Mailbox() {
+        while (auto message = pop()) {
+            delete message;
+        }
+    }
+
+    void push(Message<State>* message) {
+        message->next.store(nullptr, std::memory_order_relaxed);
+        auto prev = _head.exchange(message, std::memory_order_acq_rel);
+        prev->next.store(message, std::memory_order_release);
+    }
+
+    // Returns null when empty, or when a producer is between its exchange
+    // and its link; the caller retries later.
+    Message<State>* pop() {
+        auto tail = _tail;
+        auto next = tail->next.load(std::memory_order_acquire);
+        if (tail == &_stub) {
+            if (!next) {
+                return nullptr;
+            }
+            _tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            _tail = next;
+            return tail;
+        }
+        if (tail != _head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+
+        push(&_stub);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next) {
+            _tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+private:
+    Message<State> _stub;
+    std::atomic<Message<State>*> _head;
+    Message<State>* _tail;
+};
+
+// Meeting point between the message that computes a reply and the promise
+// task that receives resolve/reject; whichever arrives second delivers.
+template<typename R>
+class Reply {
+public:
+    template<typename Resolve, typename Reject>
+    void bind(Resolve resolve, Reject reject) {
+        _resolve = std::move(resolve);
+        _reject = std::move(reject);
+        if (_phase.fetch_or(BOUND, std::memory_order_acq_rel) & DONE) {
+            deliver();
+        }
+    }
+
+    void fulfill(R value) {
+        _value = std::move(value);
+        done();
+    }
+
+    void fail(std::exception_ptr e) {
+        _error = e;
+        done();
+    }
+
+private:
+    enum : std::uint8_t { BOUND = 1, DONE = 2 };
+
+    void done() {
+        if (_phase.fetch_or(DONE, std::memory_order_acq_rel) & BOUND) {
+            deliver();
+        }
+    }
+
+    void deliver() {
+        if (_error) {
+            _reject(_error);
+        } else {
+            _resolve(std::move(*_value));
+        }
+    }
+
+    std::atomic<std::uint8_t> _phase{0};
+    std::optional<R> _value;
+    std::exception_ptr _error;
+    std::function<void(R)> _resolve;
+    std::function<void(std::exception_ptr)> _reject;
+};
+
+template<>
+class Reply<void> {
+public:
+    template<typename Resolve, typename Reject>
+    void bind(Resolve resolve, Reject reject) {
+        _resolve = std::move(resolve);
+        _reject = std::move(reject);
+        if (_phase.fetch_or(BOUND, std::memory_order_acq_rel) & DONE) {
+            deliver();
+        }
+    }
+
+    void fulfill() {
+        done();
+    }
+
+    void fail(std::exception_ptr e) {
+        _error = e;
+        done();
+    }
+
+private:
+    enum : std::uint8_t { BOUND = 1, DONE = 2 };
+
+    void done() {
+        if (_phase.fetch_or(DONE, std::memory_order_acq_rel) & BOUND) {
+            deliver();
+        }
+    }
+
+    void deliver() {
+        if (_error) {
+            _reject(_error);
+        } else {
+            _resolve();
+        }
+    }
+
+    std::atomic<std::uint8_t> _phase{0};
+    std::exception_ptr _error;
+    std::function<void()> _resolve;
+    std::function<void(std::exception_ptr)> _reject;
+};
+
+// Travels inside an ask() message. If the message is destroyed without
+// running (its actor's executor dropped the drain), the reply rejects with
+// promise::Cancelled instead of never settling.
+template<typename R>
+struct ReplyGuard {
+    explicit ReplyGuard(std::shared_ptr<Reply<R>> reply) : reply(std::move(reply)) {}
+
+    ReplyGuard(ReplyGuard&&) = default;
+    ReplyGuard& operator=(ReplyGuard&&) = default;
+
+    ~ReplyGuard() {
+        if (reply) {
+            reply->fail(std::make_exception_ptr(Cancelled()));
+        }
+    }
+
+    std::shared_ptr<Reply<R>> take() {
+        return std::move(reply);
+    }
+
+    std::shared_ptr<Reply<R>> reply;
+};
+
+template<typename State, typename Executor>
+class ActorCore : public std::enable_shared_from_this<ActorCore<State, Executor>> {
+public:
+    ActorCore(State state, Executor executor, std::size_t batch)
+        : _state(std::move(state)), _executor(std::move(executor)), _batch(batch ? batch : 1) {}
+
+    Executor& executor() {
+        return _executor;
+    }
+
+    template<typename F>
+    void post(F fn) {
+        _mailbox.push(new MessageFn<State, F>(std::move(fn)));
+        if (_pending.fetch_add(1, std::memory_order_acq_rel) == 0) {
+            schedule();
+        }
+    }
+
+private:
+    void schedule() {
+        _executor([self = this->shared_from_this()] {
+            self->drain();
+        });
+    }
+
+    // At most one drain is scheduled at a time, so State is only ever
+    // touched by one thread. After a batch the actor yields its thread.
+    //
+    // pop() also comes back empty while a producer is between its exchange
+    // and its link. The count then says more is coming, so wait for the
+    // link briefly here; if the producer was preempted, the drain is
+    // rescheduled and comes back through the executor until it lands.
+    void drain() {
+        std::size_t processed = 0;
+        std::size_t retries = 0;
+        while (processed < _batch) {
+            auto message = _mailbox.pop();
+            if (!message) {
+                if (retries++ < link_retries && _pending.load(std::memory_order_acquire) > processed) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                break;
+            }
+            message->run(_state);
+            delete message;
+            ++processed;
+        }
+
+        if (_pending.fetch_sub(processed, std::memory_order_acq_rel) != processed) {
+            schedule();
+        }
+    }
+
+    static constexpr std::size_t link_retries = 16;
+
+    State _state;
+    Executor _executor;
+    std::size_t _batch;
+    Mailbox<State> _mailbox;
+    std::atomic<std::size_t> _pending{0};
+};
+
+}
+
+// Owns a State that only its messages touch. Messages are callables taking
+// `State&`; they run one at a time, in the order each sender sent them, on
+// the executor. Copies of an Actor share the same state.
+template<typename State, typename Executor>
+class Actor {
+public:
+    explicit Actor(State state, Executor executor = Executor(), std::size_t batch = 64)
+        : _core(std::make_shared<internal::ActorCore<State, Executor>>(std::move(state), std::move(executor), batch)) {}
+
+    // Fire and forget; exceptions thrown by fn are dropped.
+    template<typename F>
+    void tell(F fn) {
+        static_assert(std::is_invocable_v<F&, State&>, "Message must be invocable with State&");
+        _core->post([fn = std::move(fn)](State& state) mutable {
+            try {
+                fn(state);
+            } catch (...) {
+            }
+        });
+    }
+
+    // Settles with what fn returns, or rejects with what it throws. Rejects
+    // with promise::Cancelled if the message is dropped unrun.
+    template<typename F>
+    auto ask(F fn) {
+        static_assert(std::is_invocable_v<F&, State&>, "Message must be invocable with State&");
+        using R = std::invoke_result_t<F&, State&>;
+
+        auto reply = std::make_shared<internal::Reply<R>>();
+        _core->post([fn = std::move(fn), guard = internal::ReplyGuard<R>(reply)](State& state) mutable {
+            auto reply = guard.take();
+            try {
+                if constexpr (std::is_void_v<R>) {
+                    fn(state);
+                    reply->fulfill();
+                } else {
+                    reply->fulfill(fn(state));
+                }
+            } catch (...) {
+                reply->fail(std::current_exception());
+            }
+        });
+
+        return usePromise<R>([reply](auto resolve, auto reject) {
+            reply->bind(resolve, reject);
+        }, _core->executor());
+    }
+
+private:
+    std::shared_ptr<internal::ActorCore<State, Executor>> _core;
+};
+
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace promise {
+
+// Root promises created while their budget is full reject with this.
+class BudgetExceeded : public std::runtime_error {
+public:
+    BudgetExceeded() : std::runtime_error("promise memory budget exceeded") {}
+};
+
+// Bytes held by live shared states, counted shallowly: a state's own
+// allocation, which holds its value and continuation closure inline, but
+// not what those point to on the heap (a vector's elements, a long
+// string). Executors opt in with `promise::Budget* get_budget() const`.
+// A group budget can have a parent (e.g. a process-wide one); charges
+// apply to both, and admission needs room in both.
+class Budget {
+public:
+    enum class Overflow {
+        reject,  // new root promises reject with BudgetExceeded
+        wait     // new root promises block their creator until there is room
+    };
+
+    explicit Budget(
+        std::size_t limit = std::numeric_limits<std::size_t>::max(),
+        Overflow overflow = Overflow::reject,
+        Budget* parent = nullptr
+    ) : _limit(limit), _overflow(overflow), _parent(parent) {}
+
+    Budget(const Budget&) = delete;
+    Budget& operator=(const Budget&) = delete;
+
+    static Budget& global() {
+        static Budget budget;
+        return budget;
+    }
+
+    std::size_t used() const {
+        return _used.load(std::memory_order_relaxed);
+    }
+
+    std::size_t limit() const {
+        return _limit.load(std::memory_order_relaxed);
+    }
+
+    void set_limit(std::size_t limit) {
+        _limit.store(limit, std::memory_order_relaxed);
+        wake();
+    }
+
+    bool has_room() const {
+        return used() < limit() && (!_parent || _parent->has_room());
+    }
+
+    // Only root promises are admitted; continuations of admitted chains are
+    // always charged, so a chain never fails halfway through.
+    bool admit() {
+        return admit([] { return false; });
+    }
+
+    // While waiting for room, calls help() to run other work on this thread;
+    // it returns false when there was nothing to run.
+    template<typename Help>
+    bool admit(Help&& help) {
+        if (has_room()) {
+            return true;
+        }
+        if (_overflow == Overflow::reject) {
+            return false;
+        }
+
+        _waiters.fetch_add(1, std::memory_order_seq_cst);
+        while (!has_room()) {
+            if (help()) {
+                continue;
+            }
+            // Room freed in a parent does not notify us, hence the timeout.
+            std::unique_lock<std::mutex> lock(_mtx);
+            if (!has_room()) {
+                _cv.wait_for(lock, std::chrono::milliseconds(1));
+            }
+        }
+        _waiters.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void charge(std::size_t bytes) {
+        _used.fetch_add(bytes, std::memory_order_relaxed);
+        if (_parent) {
+            _parent->charge(bytes);
+        }
+    }
+
+    void release(std::size_t bytes) {
+        _used.fetch_sub(bytes, std::memory_order_seq_cst);
+        if (_parent) {
+            _parent->release(bytes);
+        }
+        if (_waiters.load(std::memory_order_seq_cst)) {
+            wake();
+        }
+    }
+
+private:
+    void wake() {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+        }
+        _cv.notify_all();
+    }
+
+    std::atomic<std::size_t> _used{0};
+    std::atomic<std::size_t> _limit;
+    Overflow _overflow;
+    Budget* _parent;
+
+    std::mutex _mtx;
+    std::condition_variable _cv;
+    std::atomic<std::size_t> _waiters{0};
+};
+
+// Charges every allocation made through Inner to a budget.
+template<typename T, typename Inner = std::allocator<T>>
+class BudgetAllocator {
+public:
+    using value_type = T;
+
+    template<typename U>
+    struct rebind {
+        using other = BudgetAllocator<U, typename std::allocator_traits<Inner>::template rebind_alloc<U>>;
+    };
+
+    BudgetAllocator(Budget& budget, Inner inner = Inner()) noexcept : _budget(&budget), _inner(std::move(inner)) {}
+
+    template<typename U, typename I>
+    BudgetAllocator(const BudgetAllocator<U, I>& other) noexcept : _budget(other._budget), _inner(other._inner) {}
+
+    T* allocate(std::size_t n) {
+        auto p = std::allocator_traits<Inner>::allocate(_inner, n);
+        _budget->charge(n * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        std::allocator_traits<Inner>::deallocate(_inner, p, n);
+        _budget->release(n * sizeof(T));
+    }
+
+    template<typename U, typename I>
+    bool operator==(const BudgetAllocator<U, I>& other) const noexcept { return _budget == other._budget && _inner == other._inner; }
+
+    template<typename U, typename I>
+    bool operator!=(const BudgetAllocator<U, I>& other) const noexcept { return !(*this == other); }
+
+private:
+    template<typename, typename>
+    friend class BudgetAllocator;
+
+    Budget* _budget;
+    Inner _inner;
+};
+
+}
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "promise.hpp"
+
+namespace promise {
+
+template<typename T>
+struct Completion {
+    std::size_t index = 0;       // position of the input
+    std::optional<T> value;      // set when the input fulfilled
+    std::exception_ptr error;    // set when it rejected
+};
+
+template<>
+struct Completion<void> {
+    std::size_t index = 0;
+    std::exception_ptr error;
+};
+
+namespace internal {
+
+// Bounded completion queue: the n-th input to settle writes slot n, so
+// producers never wait on each other and the single consumer reads slots in
+// order.
+template<typename T>
+class CompletionQueue {
+public:
+    explicit CompletionQueue(std::size_t size) : _slots(new Slot[size]), _size(size) {}
+
+    std::size_t size() const {
+        return _size;
+    }
+
+    std::size_t taken() const {
+        return _next.load(std::memory_order_relaxed);
+    }
+
+    void push(Completion<T> completion) {
+        auto& slot = _slots[_completed.fetch_add(1, std::memory_order_relaxed)];
+        slot.completion = std::move(completion);
+        if (slot.state.exchange(READY, std::memory_order_acq_rel) == WAITING) {
+            auto waiter = std::move(slot.waiter);
+            waiter(std::move(slot.completion));
+        }
+    }
+
+    // Returns the slot for the next call to wait(), or size() when every
+    // input has been handed out.
+    std::size_t take() {
+        return _next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    template<typename Resolve>
+    void wait(std::size_t index, Resolve resolve) {
+        auto& slot = _slots[index];
+        slot.waiter = resolve;
+
+        std::uint8_t expected = EMPTY;
+        if (!slot.state.compare_exchange_strong(expected, WAITING, std::memory_order_acq_rel)) {
+            slot.waiter = nullptr;
+            resolve(std::move(slot.completion));
+        }
+    }
+
+private:
+    enum : std::uint8_t { EMPTY, WAITING, READY };
+
+    struct Slot {
+        std::atomic<std::uint8_t> state{EMPTY};
+        Completion<T> completion;
+        std::function<void(Completion<T>)> waiter;
+    };
+
+    std::unique_ptr<Slot[]> _slots;
+    std::size_t _size;
+    std::atomic<std::size_t> _completed{0};
+    std::atomic<std::size_t> _next{0};
+};
+
+}
+
+// Hands out the inputs of as_completed() in the order they settle.
+template<typename T, typename Executor>
+class CompletionStream {
+public:
+    CompletionStream(std::shared_ptr<internal::CompletionQueue<T>> queue, Executor executor)
+        : _queue(std::move(queue)), _executor(std::move(executor)) {}
+
+    std::size_t size() const {
+        return _queue->size();
+    }
+
+    // Inputs not yet handed out by next().
+    std::size_t remaining() const {
+        auto taken = _queue->taken();
+        return taken < _queue->size() ? _queue->size() - taken : 0;
+    }
+
+    // Settles with the next input to settle. Rejects with std::out_of_range
+    // once every input has been handed out. Meant for a single consumer.
+    Promise<Completion<T>, Executor> next() {
+        return usePromise<Completion<T>>([queue = _queue, index = _queue->take()](auto resolve, auto reject) {
+            if (index >= queue->size()) {
+                reject(std::make_exception_ptr(std::out_of_range("as_completed: no more results")));
+                return;
+            }
+            queue->wait(index, resolve);
+        }, _executor);
+    }
+
+private:
+    std::shared_ptr<internal::CompletionQueue<T>> _queue;
+    Executor _executor;
+};
+
+// Lets a consumer handle the first responses of a fan-out while the rest are
+// still in flight, instead of waiting for all of them.
+template<typename T, typename Executor>
+inline CompletionStream<T, Executor> as_completed(std::vector<Promise<T, Executor>> promises, Executor executor = Executor()) {
+    auto queue = std::make_shared<internal::CompletionQueue<T>>(promises.size());
+
+    for (std::size_t i = 0; i < promises.size(); ++i) {
+        auto rejected = [queue, i](std::exception_ptr e) {
+            Completion<T> completion;
+            completion.index = i;
+            completion.error = e;
+            queue->push(std::move(completion));
+        };
+
+        if constexpr (std::is_void_v<T>) {
+            promises[i].then([queue, i]() {
+                queue->push(Completion<T>{i, nullptr});
+            }, rejected);
+        } else {
+            promises[i].then([queue, i](T value) {
+                queue->push(Completion<T>{i, std::move(value), nullptr});
+            }, rejected);
+        }
+    }
+
+    return CompletionStream<T, Executor>(std::move(queue), std::move(executor));
+}
+
+namespace internal {
+
+template<typename T>
+struct quorum_traits {
+    using result = std::vector<T>;
+    using slot = std::optional<T>;
+    using resolve = std::function<void(result)>;
+};
+
+template<>
+struct quorum_traits<void> {
+    using result = void;
+    using slot = char;
+    using resolve = std::function<void()>;
+};
+
+template<typename T, typename Executor>
+struct Quorum {
+    Quorum(std::size_t size, std::size_t needed) : results(std::is_void_v<T> ? 0 : needed), needed(needed), size(size) {}
+
+    std::vector<typename quorum_traits<T>::slot> results;
+    std::vector<Subscription<Executor>> subscriptions;
+    std::size_t needed;
+    std::size_t size;
+
+    std::atomic<std::size_t> fulfilled{0};
+    std::atomic<std::size_t> stored{0};
+    std::atomic<std::size_t> rejected{0};
+    std::atomic<bool> settled{false};
+    std::atomic<std::uint8_t> phase{0};
+
+    typename quorum_traits<T>::resolve resolve;
+    std::function<void(std::exception_ptr)> reject;
+
+    enum : std::uint8_t { ARMED = 1, DECIDED = 2 };
+
+    template<typename... V>
+    void fulfill(V&&... value) {
+        auto slot = fulfilled.fetch_add(1, std::memory_order_relaxed);
+        if (slot >= needed) {
+            return;
+        }
+        if constexpr (!std::is_void_v<T>) {
+            ((results[slot] = std::forward<V>(value)), ...);
+        }
+        if (stored.fetch_add(1, std::memory_order_acq_rel) + 1 != needed || settled.exchange(true)) {
+            return;
+        }
+
+        if constexpr (std::is_void_v<T>) {
+            resolve();
+        } else {
+            std::vector<T> values;
+            values.reserve(needed);
+            for (auto& result : results) {
+                values.push_back(std::move(*result));
+            }
+            resolve(std::move(values));
+        }
+        decided();
+    }
+
+    void fail(std::exception_ptr e) {
+        if (rejected.fetch_add(1, std::memory_order_relaxed) + 1 != size - needed + 1 || settled.exchange(true)) {
+            return;
+        }
+        reject(e);
+        decided();
+    }
+
+    // Whichever of arming and deciding comes second detaches the inputs
+    // that are still pending, so subscriptions is complete by then.
+    void armed() {
+        if (phase.fetch_or(ARMED, std::memory_order_acq_rel) & DECIDED) {
+            cancel_rest();
+        }
+    }
+
+    void decided() {
+        if (phase.fetch_or(DECIDED, std::memory_order_acq_rel) & ARMED) {
+            cancel_rest();
+        }
+    }
+
+    void cancel_rest() {
+        for (auto& subscription : subscriptions) {
+            subscription.cancel();
+        }
+    }
+};
+
+}
+
+// Fulfills with the first k values, in the order they arrived, or rejects
+// with the error that made k successes impossible. Once decided, the
+// continuations on inputs that are still pending are unsubscribed.
+template<typename T, typename Executor>
+inline auto quorum(std::vector<Promise<T, Executor>> promises, std::size_t k, Executor executor = Executor()) {
+    return usePromise<typename internal::quorum_traits<T>::result>([promises = std::move(promises), k](auto resolve, auto reject) {
+        if (k > promises.size()) {
+            reject(std::make_exception_ptr(std::invalid_argument("quorum: k is larger than the number of promises")));
+            return;
+        }
+        if (k == 0) {
+            if constexpr (std::is_void_v<T>) {
+                resolve();
+            } else {
+                resolve(std::vector<T>{});
+            }
+            return;
+        }
+
+        auto state = std::make_shared<internal::Quorum<T, Executor>>(promises.size(), k);
+        state->resolve = resolve;
+        state->reject = reject;
+        state->subscriptions.reserve(promises.size());
+
+        for (auto input : promises) {
+            auto rejected = [state](std::exception_ptr e) {
+                state->fail(e);
+            };
+
+            if constexpr (std::is_void_v<T>) {
+                state->subscriptions.push_back(input.subscribe([state]() {
+                    state->fulfill();
+                }, rejected).second);
+            } else {
+                state->subscriptions.push_back(input.subscribe([state](T value) {
+                    state->fulfill(std::move(value));
+                }, rejected).second);
+            }
+        }
+        state->armed();
+    }, std::move(executor));
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <time.h>
+#endif
+
+#include "trace.hpp"
+
+namespace promise {
+
+namespace cost {
+
+enum class Clock {
+    // CPU time of the running thread, in nanoseconds; excludes time the
+    // thread spent descheduled or blocked.
+    thread_cpu,
+    // trace::ticks() deltas: far cheaper to read, but wall time, and TSC
+    // cycles on x86.
+    ticks,
+};
+
+inline std::uint64_t now(Clock clock) noexcept {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    if (clock == Clock::thread_cpu) {
+        struct timespec ts;
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000u + static_cast<std::uint64_t>(ts.tv_nsec);
+    }
+#endif
+    (void)clock;
+    return trace::ticks();
+}
+
+// Time spent running the callbacks of the chains billed to it, summed over
+// every thread that ran one.
+class Account {
+public:
+    explicit Account(Clock clock = Clock::thread_cpu) : _clock(clock) {}
+
+    Account(const Account&) = delete;
+    Account& operator=(const Account&) = delete;
+
+    Clock clock() const {
+        return _clock;
+    }
+
+    // In the unit of clock().
+    std::uint64_t total() const {
+        return _total.load(std::memory_order_relaxed);
+    }
+
+    // Callbacks measured.
+    std::uint64_t runs() const {
+        return _runs.load(std::memory_order_relaxed);
+    }
+
+    void add(std::uint64_t amount) {
+        _total.fetch_add(amount, std::memory_order_relaxed);
+        _runs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    Clock _clock;
+    std::atomic<std::uint64_t> _total{0};
+    std::atomic<std::uint64_t> _runs{0};
+};
+
+class Meter;
+
+namespace internal {
+
+// The account points at a shared_ptr owned by a Scope or a running chain's
+// state, so switching accounts touches no reference count.
+struct Tls {
+    const std::shared_ptr<Account>* account = nullptr;
+    Meter* meter = nullptr;
+};
+
+inline Tls& tls() {
+    thread_local Tls tls;
+    return tls;
+}
+
+}
+
+// Account that root promises created on this thread are billed to, or null.
+inline std::shared_ptr<Account> current() {
+    auto account = internal::tls().account;
+    return account ? *account : nullptr;
+}
+
+// Bills root promises created on this thread while it is alive to account;
+// their continuations, and roots created inside those, follow.
+class Scope {
+public:
+    explicit Scope(std::shared_ptr<Account> account)
+        : _account(std::move(account)), _previous(std::exchange(internal::tls().account, &_account)) {}
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope() {
+        internal::tls().account = _previous;
+    }
+
+private:
+    std::shared_ptr<Account> _account;
+    const std::shared_ptr<Account>* _previous;
+};
+
+// Measures one callback run into account, if there is one, and makes it
+// the current account meanwhile. A callback that runs others inline (on a
+// synchronous executor) is billed only for its own share.
+class Meter {
+public:
+    explicit Meter(const std::shared_ptr<Account>* account) : _account(account) {
+        if (_account) {
+            auto& tls = internal::tls();
+            _previous = std::exchange(tls.account, _account);
+            _outer = std::exchange(tls.meter, this);
+            _start = now((*_account)->clock());
+        }
+    }
+
+    Meter(const Meter&) = delete;
+    Meter& operator=(const Meter&) = delete;
+
+    ~Meter() {
+        if (_account) {
+            auto& account = **_account;
+            auto elapsed = now(account.clock()) - _start;
+            account.add(elapsed - std::min(_nested, elapsed));
+
+            auto& tls = internal::tls();
+            tls.account = _previous;
+            tls.meter = _outer;
+            if (_outer && _outer->_account && (*_outer->_account)->clock() == account.clock()) {
+                _outer->_nested += elapsed;
+            }
+        }
+    }
+
+private:
+    const std::shared_ptr<Account>* _account;
+    const std::shared_ptr<Account>* _previous = nullptr;
+    Meter* _outer = nullptr;
+    std::uint64_t _start = 0;
+    std::uint64_t _nested = 0;
+};
+
+}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#if __has_include(<version>)
+    #include <version>
+#endif
+
+#if defined(__cpp_lib_senders)
+    #include <execution>
+#endif
+
+namespace promise {
+
+// Tags of the sender/receiver model (P2300). With a standard library that
+// ships std::execution they are the standard ones; otherwise these stand-ins
+// carry the same names, so types written against them keep the member
+// protocol (connect, start, set_value, set_error, set_stopped, schedule).
+namespace execution {
+
+#if defined(__cpp_lib_senders)
+using std::execution::completion_signatures;
+using std::execution::operation_state_t;
+using std::execution::receiver_t;
+using std::execution::scheduler_t;
+using std::execution::sender_t;
+using std::execution::set_error_t;
+using std::execution::set_stopped_t;
+using std::execution::set_value_t;
+#else
+struct sender_t {};
+struct receiver_t {};
+struct operation_state_t {};
+struct scheduler_t {};
+
+struct set_value_t {};
+struct set_error_t {};
+struct set_stopped_t {};
+
+template<typename... Signatures>
+struct completion_signatures {};
+#endif
+
+struct empty_env {};
+
+}
+
+}
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "promise.hpp"
+
+namespace promise {
+
+class ThreadPool;
+
+struct PoolExecutor {
+    ThreadPool* pool;
+
+    template<typename F>
+    inline void operator()(F f) const;
+
+    inline bool help() const;
+
+    inline bool owns_current_thread() const;
+
+    bool operator==(const PoolExecutor& other) const {
+        return pool == other.pool;
+    }
+
+    bool operator!=(const PoolExecutor& other) const {
+        return pool != other.pool;
+    }
+};
+
+// Worker threads sharing one queue. Every task that is queued or running is
+// counted, so shutdown can wait for detached chains to finish instead of
+// sleeping for a guessed amount of time.
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+
+    explicit ThreadPool(std::size_t threads = std::max(1u, std::thread::hardware_concurrency())) {
+        for (std::size_t i = 0; i < std::max<std::size_t>(threads, 1); ++i) {
+            _threads.emplace_back([this] { loop(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        shutdown();
+    }
+
+    PoolExecutor executor() {
+        return PoolExecutor{this};
+    }
+
+    // Tasks posted after shutdown passed its deadline are dropped, except
+    // the continuations of drain() promises shutdown() settles itself.
+    void post(Task task) {
+        std::unique_lock<std::mutex> lock(_mtx);
+        if (_stopped) {
+            lock.unlock();
+            if (settling() == this) {
+                task();
+            }
+            return;
+        }
+        _outstanding.fetch_add(1, std::memory_order_relaxed);
+        _tasks.push_back(std::move(task));
+        lock.unlock();
+        _cv.notify_one();
+    }
+
+    // Tasks queued or running right now.
+    std::size_t outstanding() const {
+        return _outstanding.load(std::memory_order_acquire);
+    }
+
+    // Settles the next time no task is queued or running. Work that waits on
+    // something outside the pool (a timer, a socket) is not counted. Still
+    // pending when shutdown() gives up at its deadline, it rejects with
+    // promise::Cancelled.
+    Promise<void, PoolExecutor> drain() {
+        return usePromise<void>([this](auto resolve, auto reject) {
+            // Runs as a pool task, so the count is at least one here and
+            // our own completion fires the waiter at the latest.
+            std::lock_guard<std::mutex> lock(_mtx);
+            _waiters.push_back(Waiter{resolve, reject});
+            _watchers.fetch_add(1, std::memory_order_seq_cst);
+        }, executor());
+    }
+
+    // Keeps running work, including continuations posted by running chains,
+    // until the pool is quiescent or the deadline passes. Whatever is still
+    // queued at that point is destroyed without running; tasks already
+    // running are waited for. Returns true if the pool drained in time.
+    // Must not be called from a pool thread.
+    bool shutdown(Clock::time_point deadline = Clock::time_point::max()) {
+        std::deque<Task> dropped;
+        std::vector<Waiter> waiters;
+        bool quiet;
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            if (_stopped) {
+                return _outstanding.load(std::memory_order_acquire) == 0;
+            }
+
+            _watchers.fetch_add(1, std::memory_order_seq_cst);
+            auto idle = [&] { return _outstanding.load(std::memory_order_seq_cst) == 0; };
+            if (deadline == Clock::time_point::max()) {
+                _idle_cv.wait(lock, idle);
+                quiet = true;
+            } else {
+                quiet = _idle_cv.wait_until(lock, deadline, idle);
+            }
+            _watchers.fetch_sub(1, std::memory_order_relaxed);
+
+            _stopped = true;
+            dropped.swap(_tasks);
+            waiters.swap(_waiters);
+            _outstanding.fetch_sub(dropped.size(), std::memory_order_acq_rel);
+        }
+        _cv.notify_all();
+
+        for (auto& thread : _threads) {
+            assert(thread.get_id() != std::this_thread::get_id() && "ThreadPool::shutdown called from a pool thread");
+            thread.join();
+        }
+        _threads.clear();
+
+        // No worker is left to run what settling these posts, so this
+        // thread runs it.
+        auto error = std::make_exception_ptr(Cancelled());
+        settling() = this;
+        for (auto& waiter : waiters) {
+            if (quiet) {
+                waiter.resolve();
+            } else {
+                waiter.reject(error);
+            }
+        }
+        settling() = nullptr;
+        return quiet;
+    }
+
+    template<typename Rep, typename Period>
+    bool shutdown_for(std::chrono::duration<Rep, Period> timeout) {
+        return shutdown(Clock::now() + timeout);
+    }
+
+    // Runs one queued task on the calling thread if it is a worker of this
+    // pool, so a worker blocked on a promise keeps the pool going instead
+    // of waiting for a continuation stuck behind it in the queue. Returns
+    // false when nothing ran.
+    bool help() {
+        if (current() != this) {
+            return false;
+        }
+
+        Task task;
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            if (_stopped || _tasks.empty()) {
+                return false;
+            }
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+        run(task);
+        return true;
+    }
+
+    // Whether the calling thread is one of this pool's workers.
+    bool owns_current_thread() const {
+        return current() == this;
+    }
+
+private:
+    struct Waiter {
+        Task resolve;
+        std::function<void(std::exception_ptr)> reject;
+    };
+
+    static ThreadPool*& current() {
+        thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    static ThreadPool*& settling() {
+        thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    void loop() {
+        current() = this;
+        while (true) {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _cv.wait(lock, [&] { return _stopped || !_tasks.empty(); });
+                if (_stopped) {
+                    break;
+                }
+                task = std::move(_tasks.front());
+                _tasks.pop_front();
+            }
+            run(task);
+        }
+        current() = nullptr;
+    }
+
+    void run(Task& task) {
+        task();
+        task = nullptr;
+
+        if (_outstanding.fetch_sub(1, std::memory_order_seq_cst) == 1
+            && _watchers.load(std::memory_order_seq_cst)) {
+            quiescent();
+        }
+    }
+
+    void quiescent() {
+        std::vector<Waiter> waiters;
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            if (_outstanding.load(std::memory_order_acquire) != 0) {
+                return;
+            }
+            waiters.swap(_waiters);
+            _watchers.fetch_sub(waiters.size(), std::memory_order_relaxed);
+        }
+        _idle_cv.notify_all();
+
+        for (auto& waiter : waiters) {
+            waiter.resolve();
+        }
+    }
+
+    std::mutex _mtx;
+    std::condition_variable _cv;
+    std::condition_variable _idle_cv;
+    std::deque<Task> _tasks;
+    std::vector<Waiter> _waiters;
+    bool _stopped = false;
+
+    std::atomic<std::size_t> _outstanding{0};
+    // drain() waiters plus threads blocked in shutdown(); workers only take
+    // the lock on reaching zero when someone is watching.
+    std::atomic<std::size_t> _watchers{0};
+
+    std::vector<std::thread> _threads;
+};
+
+template<typename F>
+inline void PoolExecutor::operator()(F f) const {
+    pool->post(std::move(f));
+}
+
+inline bool PoolExecutor::help() const {
+    return pool->help();
+}
+
+inline bool PoolExecutor::owns_current_thread() const {
+    return pool->owns_current_thread();
+}
+
+}
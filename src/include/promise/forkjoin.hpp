@@ -0,0 +1,412 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "promise.hpp"
+
+namespace promise {
+
+namespace internal {
+
+struct ForkJoinJob {
+    virtual ~ForkJoinJob() = default;
+    virtual void execute() = 0;
+
+    std::atomic<bool> done{false};
+};
+
+// Chase-Lev work-stealing deque with a fixed capacity: the owner pushes and
+// pops at the bottom, thieves take from the top.
+class WorkDeque {
+public:
+    explicit WorkDeque(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        _slots = std::make_unique<std::atomic<ForkJoinJob*>[]>(size);
+        _mask = size - 1;
+    }
+
+    bool push(ForkJoinJob* job) {
+        auto b = _bottom.load(std::memory_order_relaxed);
+        auto t = _top.load(std::memory_order_acquire);
+        if (b - t > static_cast<std::int64_t>(_mask)) {
+            return false;
+        }
+        _slots[b & _mask].store(job, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_release);
+        _bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    ForkJoinJob* pop() {
+        auto b = _bottom.load(std::memory_order_relaxed) - 1;
+        _bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = _top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            _bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        auto job = _slots[b & _mask].load(std::memory_order_relaxed);
+        if (t == b) {
+            if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                job = nullptr;
+            }
+            _bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    ForkJoinJob* steal() {
+        auto t = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto b = _bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return nullptr;
+        }
+
+        auto job = _slots[t & _mask].load(std::memory_order_acquire);
+        if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return job;
+    }
+
+    // A hint from any thread; an owner's pop in progress only ever shows
+    // the deque as it will be once the pop is done.
+    bool empty() const {
+        return _bottom.load(std::memory_order_acquire) <= _top.load(std::memory_order_acquire);
+    }
+
+private:
+    std::unique_ptr<std::atomic<ForkJoinJob*>[]> _slots;
+    std::size_t _mask = 0;
+    alignas(64) std::atomic<std::int64_t> _top{0};
+    alignas(64) std::atomic<std::int64_t> _bottom{0};
+};
+
+}
+
+class ForkJoinPool;
+
+// A child started by ForkJoinPool::spawn(). It lives in the spawning frame
+// and must be synced there; it is never moved or heap allocated.
+template<typename F>
+class Spawned : internal::ForkJoinJob {
+public:
+    using result_type = std::invoke_result_t<F&>;
+
+    Spawned(const Spawned&) = delete;
+    Spawned& operator=(const Spawned&) = delete;
+
+    ~Spawned() {
+        if (!_synced) {
+            wait();
+        }
+    }
+
+    // Runs the child here if nobody stole it, otherwise helps with other
+    // work until the thief finishes. Rethrows what the child threw.
+    result_type sync();
+
+private:
+    friend class ForkJoinPool;
+
+    Spawned(ForkJoinPool& pool, F fn);
+
+    void execute() override {
+        try {
+            if constexpr (std::is_void_v<result_type>) {
+                _fn();
+            } else {
+                _result.emplace(_fn());
+            }
+        } catch (...) {
+            _error = std::current_exception();
+        }
+        done.store(true, std::memory_order_release);
+    }
+
+    void wait();
+
+    ForkJoinPool& _pool;
+    F _fn;
+    std::optional<std::conditional_t<std::is_void_v<result_type>, bool, result_type>> _result;
+    std::exception_ptr _error;
+    bool _synced = false;
+};
+
+// Work-stealing pool for recursive divide and conquer. Each worker owns a
+// deque; spawn() pushes a pointer to a child living on the caller's stack,
+// idle workers steal the oldest (largest) children, and sync() runs the
+// child inline when it was not stolen. A split therefore costs no shared
+// state and no std::function.
+class ForkJoinPool {
+public:
+    explicit ForkJoinPool(
+        std::size_t threads = std::max(1u, std::thread::hardware_concurrency()),
+        std::size_t deque_capacity = 4096
+    ) {
+        for (std::size_t i = 0; i < std::max<std::size_t>(threads, 1); ++i) {
+            _workers.push_back(std::make_unique<Worker>(deque_capacity));
+        }
+        for (std::size_t i = 0; i < _workers.size(); ++i) {
+            _workers[i]->thread = std::thread([this, i] { loop(i); });
+        }
+    }
+
+    ForkJoinPool(const ForkJoinPool&) = delete;
+    ForkJoinPool& operator=(const ForkJoinPool&) = delete;
+
+    ~ForkJoinPool() {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _stopping = true;
+        }
+        _cv.notify_all();
+        for (auto& worker : _workers) {
+            worker->thread.join();
+        }
+    }
+
+    std::size_t size() const {
+        return _workers.size();
+    }
+
+    // Must be called from inside the pool, i.e. from fork_join() or a
+    // spawned child.
+    template<typename F>
+    Spawned<F> spawn(F fn) {
+        return Spawned<F>(*this, std::move(fn));
+    }
+
+    template<typename F, typename Executor>
+    friend auto fork_join(ForkJoinPool& pool, F fn, Executor executor);
+
+private:
+    template<typename>
+    friend class Spawned;
+
+    struct Worker {
+        explicit Worker(std::size_t capacity) : deque(capacity) {}
+
+        internal::WorkDeque deque;
+        std::thread thread;
+    };
+
+    struct Tls {
+        ForkJoinPool* pool = nullptr;
+        std::size_t index = 0;
+    };
+
+    static Tls& tls() {
+        thread_local Tls tls;
+        return tls;
+    }
+
+    Worker& current() {
+        assert(tls().pool == this && "spawn() called outside its ForkJoinPool");
+        return *_workers[tls().index];
+    }
+
+    void inject(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _injected.push_back(std::move(task));
+        }
+        _cv.notify_one();
+    }
+
+    // Pairs with the fence in loop(): either the spawner sees a worker
+    // sleeping and notifies it, or the worker sees the new child.
+    void wake() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_sleeping.load(std::memory_order_relaxed)) {
+            {
+                std::lock_guard<std::mutex> lock(_mtx);
+            }
+            _cv.notify_one();
+        }
+    }
+
+    bool has_work() const {
+        if (!_injected.empty()) {
+            return true;
+        }
+        for (auto& worker : _workers) {
+            if (!worker->deque.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Steals from a random victim; helps sync() and idle workers.
+    bool try_steal(std::size_t self) {
+        thread_local std::uint32_t seed = static_cast<std::uint32_t>(self * 2654435761u) | 1;
+        auto n = _workers.size();
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        for (std::size_t i = 0; i < n; ++i) {
+            auto victim = (seed + i) % n;
+            if (victim == self) {
+                continue;
+            }
+            if (auto job = _workers[victim]->deque.steal()) {
+                job->execute();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Yields for a while, then sleeps up to max_backoff, so a sync() waiting
+    // on a long stolen child does not burn its core.
+    static void backoff(std::size_t idle) {
+        if (idle < spin_limit) {
+            std::this_thread::yield();
+            return;
+        }
+        auto shift = std::min<std::size_t>(idle - spin_limit, 8);
+        std::this_thread::sleep_for(std::min(std::chrono::microseconds(1 << shift), max_backoff));
+    }
+
+    static constexpr std::size_t spin_limit = 64;
+    static constexpr std::chrono::microseconds max_backoff{200};
+
+    bool run_injected() {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            if (_injected.empty()) {
+                return false;
+            }
+            task = std::move(_injected.front());
+            _injected.pop_front();
+        }
+        task();
+        return true;
+    }
+
+    void loop(std::size_t index) {
+        tls() = Tls{this, index};
+        auto& self = *_workers[index];
+
+        while (true) {
+            if (auto job = self.deque.pop()) {
+                job->execute();
+                continue;
+            }
+            if (run_injected() || try_steal(index)) {
+                continue;
+            }
+
+            _sleeping.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::unique_lock<std::mutex> lock(_mtx);
+            _cv.wait(lock, [&] {
+                return _stopping || has_work();
+            });
+            _sleeping.fetch_sub(1, std::memory_order_relaxed);
+            if (_stopping && _injected.empty()) {
+                break;
+            }
+        }
+
+        tls() = Tls{};
+    }
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+
+    std::mutex _mtx;
+    std::condition_variable _cv;
+    std::deque<std::function<void()>> _injected;
+    std::atomic<std::size_t> _sleeping{0};
+    bool _stopping = false;
+};
+
+template<typename F>
+Spawned<F>::Spawned(ForkJoinPool& pool, F fn) : _pool(pool), _fn(std::move(fn)) {
+    if (!_pool.current().deque.push(this)) {
+        execute();
+        return;
+    }
+    _pool.wake();
+}
+
+template<typename F>
+void Spawned<F>::wait() {
+    _synced = true;
+    auto self = ForkJoinPool::tls().index;
+    auto& worker = _pool.current();
+
+    // Our own deque may still hold this child under younger siblings synced
+    // later, so keep popping it rather than only stealing from others.
+    std::size_t idle = 0;
+    while (!done.load(std::memory_order_acquire)) {
+        if (auto job = worker.deque.pop()) {
+            job->execute();
+        } else if (!_pool.try_steal(self) && !_pool.run_injected()) {
+            ForkJoinPool::backoff(idle++);
+            continue;
+        }
+        idle = 0;
+    }
+}
+
+template<typename F>
+typename Spawned<F>::result_type Spawned<F>::sync() {
+    wait();
+    if (_error) {
+        std::rethrow_exception(_error);
+    }
+    if constexpr (!std::is_void_v<result_type>) {
+        return std::move(*_result);
+    }
+}
+
+// Runs fn(pool) on a pool worker and settles the returned promise with its
+// result on executor.
+template<typename F, typename Executor>
+inline auto fork_join(ForkJoinPool& pool, F fn, Executor executor) {
+    using R = std::invoke_result_t<F&, ForkJoinPool&>;
+
+    return usePromise<R>([&pool, fn = std::move(fn)](auto resolve, auto reject) {
+        pool.inject([&pool, fn, resolve, reject]() mutable {
+            try {
+                if constexpr (std::is_void_v<R>) {
+                    fn(pool);
+                    resolve();
+                } else {
+                    resolve(fn(pool));
+                }
+            } catch (...) {
+                reject(std::current_exception());
+            }
+        });
+    }, std::move(executor));
+}
+
+}
@@ -0,0 +1,327 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "promise.hpp"
+
+namespace promise {
+
+namespace fs {
+
+struct Entry {
+    std::string path;
+    unsigned char type;  // DT_REG, DT_DIR, DT_LNK, ...
+    std::uint64_t inode;
+};
+
+struct WalkOptions {
+    // Directories read at the same time.
+    std::size_t max_concurrency = std::max(1u, std::thread::hardware_concurrency());
+    // Entries collected before the visitor is called; a batch can run over
+    // by one getdents buffer.
+    std::size_t batch_size = 256;
+    // Queued directories that keep their fd open for openat(); beyond this
+    // they are reopened by path when their turn comes.
+    std::size_t max_open_dirs = 256;
+};
+
+struct WalkStats {
+    // Regular files; symlinks, FIFOs, sockets and devices are reported to
+    // the visitor but not counted.
+    std::size_t files = 0;
+    std::size_t directories = 0;
+    std::size_t errors = 0;
+};
+
+namespace internal {
+
+template<typename Visitor, typename Executor>
+class Walker : public std::enable_shared_from_this<Walker<Visitor, Executor>> {
+public:
+    Walker(Visitor visitor, Executor executor, WalkOptions options)
+        : _visitor(std::move(visitor)), _executor(std::move(executor)), _options(options) {
+        _options.max_concurrency = std::max<std::size_t>(_options.max_concurrency, 1);
+        _options.batch_size = std::max<std::size_t>(_options.batch_size, 1);
+    }
+
+    ~Walker() {
+        for (auto& dir : _queue) {
+            if (dir.fd >= 0) {
+                ::close(dir.fd);
+            }
+        }
+    }
+
+    void start(
+        std::string root,
+        std::function<void(WalkStats)> resolve,
+        std::function<void(std::exception_ptr)> reject
+    ) {
+        _resolve = std::move(resolve);
+        _reject = std::move(reject);
+
+        int fd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            _reject(std::make_exception_ptr(std::system_error(errno, std::generic_category(), "open " + root)));
+            return;
+        }
+
+        _open_dirs.fetch_add(1, std::memory_order_relaxed);
+        std::vector<PendingDir> dirs;
+        dirs.push_back({fd, std::move(root)});
+        enqueue(dirs);
+    }
+
+private:
+    struct PendingDir {
+        int fd = -1;
+        std::string path;
+    };
+
+    // Called with new directories; starts workers up to the concurrency
+    // limit.
+    void enqueue(std::vector<PendingDir>& dirs) {
+        std::size_t spawn = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            for (auto& dir : dirs) {
+                _queue.push_back(std::move(dir));
+            }
+            while (_active < _options.max_concurrency && _active < _queue.size()) {
+                ++_active;
+                ++spawn;
+            }
+        }
+        dirs.clear();
+
+        for (std::size_t i = 0; i < spawn; ++i) {
+            _executor([self = this->shared_from_this()] {
+                self->work();
+            });
+        }
+    }
+
+    void work() {
+        WalkStats stats;
+        do {
+            std::vector<Entry> batch;
+            stats = WalkStats{};
+
+            while (true) {
+                PendingDir dir;
+                {
+                    std::lock_guard<std::mutex> lock(_mtx);
+                    if (_queue.empty() || _error) {
+                        break;
+                    }
+                    dir = std::move(_queue.front());
+                    _queue.pop_front();
+                }
+
+                try {
+                    read(dir, batch, stats);
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+            }
+
+            try {
+                if (!batch.empty()) {
+                    _visitor(static_cast<const std::vector<Entry>&>(batch));
+                }
+            } catch (...) {
+                fail(std::current_exception());
+            }
+        } while (!finish(stats));
+    }
+
+    void fail(std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (!_error) {
+            _error = error;
+        }
+    }
+
+    // Returns false when this worker should go back to the queue: another
+    // worker may have queued directories after we saw it empty, and the
+    // last one to leave must not strand them.
+    bool finish(const WalkStats& stats) {
+        std::exception_ptr error;
+        WalkStats total;
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _stats.files += stats.files;
+            _stats.directories += stats.directories;
+            _stats.errors += stats.errors;
+
+            if (_active > 1) {
+                --_active;
+                return true;
+            }
+            if (!_queue.empty() && !_error) {
+                return false;
+            }
+
+            _active = 0;
+            error = _error;
+            total = _stats;
+        }
+
+        if (error) {
+            _reject(error);
+        } else {
+            _resolve(total);
+        }
+        return true;
+    }
+
+    void read(PendingDir& dir, std::vector<Entry>& batch, WalkStats& stats) {
+        int fd = dir.fd;
+        if (fd < 0) {
+            // Like openat() below, refuse a directory swapped for a symlink
+            // since it was listed.
+            fd = ::open(dir.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+        } else {
+            _open_dirs.fetch_sub(1, std::memory_order_relaxed);
+        }
+        if (fd < 0) {
+            ++stats.errors;
+            return;
+        }
+
+        struct Closer {
+            int fd;
+            ~Closer() { ::close(fd); }
+        } closer{fd};
+
+        std::vector<PendingDir> subdirs;
+        alignas(8) char buffer[32 * 1024];
+
+        while (true) {
+            auto n = ::syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+            if (n <= 0) {
+                stats.errors += n < 0;
+                break;
+            }
+
+            // struct linux_dirent64: u64 ino, s64 off, u16 reclen, u8 type, name.
+            for (long offset = 0; offset < n;) {
+                const char* record = buffer + offset;
+
+                std::uint64_t inode;
+                std::uint16_t reclen;
+                std::memcpy(&inode, record, sizeof(inode));
+                std::memcpy(&reclen, record + 16, sizeof(reclen));
+                unsigned char type = static_cast<unsigned char>(record[18]);
+                const char* name = record + 19;
+                offset += reclen;
+
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                    continue;
+                }
+
+                if (type == DT_UNKNOWN) {
+                    struct stat st;
+                    if (::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                        ++stats.errors;
+                        continue;
+                    }
+                    type = IFTODT(st.st_mode);
+                }
+
+                auto path = dir.path;
+                if (path.empty() || path.back() != '/') {
+                    path += '/';
+                }
+                path += name;
+
+                if (type == DT_DIR) {
+                    ++stats.directories;
+
+                    int child = -1;
+                    if (_open_dirs.fetch_add(1, std::memory_order_relaxed) < _options.max_open_dirs) {
+                        child = ::openat(fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+                    }
+                    if (child < 0) {
+                        _open_dirs.fetch_sub(1, std::memory_order_relaxed);
+                    }
+                    subdirs.push_back({child, path});
+                } else if (type == DT_REG) {
+                    ++stats.files;
+                }
+
+                batch.push_back({std::move(path), type, inode});
+            }
+
+            if (!subdirs.empty()) {
+                enqueue(subdirs);
+            }
+            if (batch.size() >= _options.batch_size) {
+                _visitor(static_cast<const std::vector<Entry>&>(batch));
+                batch.clear();
+            }
+        }
+    }
+
+    Visitor _visitor;
+    Executor _executor;
+    WalkOptions _options;
+
+    std::function<void(WalkStats)> _resolve;
+    std::function<void(std::exception_ptr)> _reject;
+
+    std::mutex _mtx;
+    std::deque<PendingDir> _queue;
+    std::size_t _active = 0;
+    std::exception_ptr _error;
+    WalkStats _stats;
+    std::atomic<std::size_t> _open_dirs{0};
+};
+
+}
+
+// Walks the tree under root in parallel on executor, calling visitor with
+// batches of entries (`const std::vector<Entry>&`) from several threads at
+// once. The promise settles with totals once every directory has been read,
+// or rejects with the first exception thrown by the visitor. Unreadable
+// directories and entries that cannot be typed are skipped and counted in
+// WalkStats::errors.
+template<typename Visitor, typename Executor>
+inline auto walk(std::string root, Visitor visitor, Executor executor, WalkOptions options = {}) {
+    static_assert(std::is_invocable_v<Visitor&, const std::vector<Entry>&>, "Visitor must be invocable with const std::vector<Entry>&");
+
+    auto walker = std::make_shared<internal::Walker<Visitor, Executor>>(std::move(visitor), executor, options);
+    return usePromise<WalkStats>([walker, root = std::move(root)](auto resolve, auto reject) {
+        walker->start(root, resolve, reject);
+    }, std::move(executor));
+}
+
+}
+
+}
+
+#endif
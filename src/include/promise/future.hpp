@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "promise.hpp"
+
+namespace promise {
+
+namespace internal {
+
+template<typename Future, typename Resolve, typename Reject>
+inline void settle(Future& future, Resolve& resolve, Reject& reject) {
+    try {
+        if constexpr (std::is_void_v<decltype(future.get())>) {
+            future.get();
+            resolve();
+        } else {
+            resolve(future.get());
+        }
+    } catch (...) {
+        reject(std::current_exception());
+    }
+}
+
+struct PendingFuture {
+    virtual ~PendingFuture() = default;
+    // Settles the promise and returns true once the future is ready.
+    virtual bool poll() = 0;
+};
+
+template<typename Future, typename Resolve, typename Reject>
+struct PendingFutureFor : PendingFuture {
+    PendingFutureFor(std::shared_ptr<Future> future, Resolve resolve, Reject reject)
+        : future(std::move(future)), resolve(std::move(resolve)), reject(std::move(reject)) {}
+
+    bool poll() override {
+        if (future->wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+        settle(*future, resolve, reject);
+        return true;
+    }
+
+    std::shared_ptr<Future> future;
+    Resolve resolve;
+    Reject reject;
+};
+
+// One thread for every future handed to fromFuture(). It polls them with
+// wait_for(0), backing off while nothing completes and snapping back to the
+// shortest interval as soon as something does; with nothing to watch it
+// sleeps until the next add().
+class FuturePoller {
+public:
+    static constexpr std::chrono::microseconds min_interval{50};
+    static constexpr std::chrono::microseconds max_interval{5000};
+
+    static FuturePoller& instance() {
+        static FuturePoller poller;
+        return poller;
+    }
+
+    ~FuturePoller() {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _stopping = true;
+        }
+        _cv.notify_one();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+    void add(std::unique_ptr<PendingFuture> pending) {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _incoming.push_back(std::move(pending));
+            if (!_thread.joinable()) {
+                _thread = std::thread([this] { loop(); });
+            }
+        }
+        _cv.notify_one();
+    }
+
+private:
+    FuturePoller() = default;
+
+    void loop() {
+        std::vector<std::unique_ptr<PendingFuture>> watched;
+        auto interval = min_interval;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                if (watched.empty()) {
+                    _cv.wait(lock, [&] { return _stopping || !_incoming.empty(); });
+                } else {
+                    _cv.wait_for(lock, interval, [&] { return _stopping || !_incoming.empty(); });
+                }
+                if (_stopping) {
+                    return;
+                }
+                if (!_incoming.empty()) {
+                    interval = min_interval;
+                }
+                for (auto& pending : _incoming) {
+                    watched.push_back(std::move(pending));
+                }
+                _incoming.clear();
+            }
+
+            auto before = watched.size();
+            watched.erase(std::remove_if(watched.begin(), watched.end(), [](auto& pending) {
+                return pending->poll();
+            }), watched.end());
+
+            interval = watched.size() < before ? min_interval : std::min(interval * 2, max_interval);
+        }
+    }
+
+    std::mutex _mtx;
+    std::condition_variable _cv;
+    std::vector<std::unique_ptr<PendingFuture>> _incoming;
+    bool _stopping = false;
+    std::thread _thread;
+};
+
+template<typename T, typename Future, typename Executor>
+inline auto bridge_future(std::shared_ptr<Future> future, Executor executor) {
+    return usePromise<T>([future](auto resolve, auto reject) {
+        if (!future->valid()) {
+            reject(std::make_exception_ptr(std::future_error(std::future_errc::no_state)));
+            return;
+        }
+
+        // Ready futures settle at once; deferred ones only run inside get(),
+        // so they run here on the executor rather than stall the poller.
+        if (future->wait_for(std::chrono::seconds(0)) != std::future_status::timeout) {
+            settle(*future, resolve, reject);
+            return;
+        }
+
+        using Pending = PendingFutureFor<Future, decltype(resolve), decltype(reject)>;
+        FuturePoller::instance().add(std::make_unique<Pending>(future, resolve, reject));
+    }, std::move(executor));
+}
+
+}
+
+// Adopts a std::future without parking a thread on get(): a single shared
+// poller thread watches every adopted future.
+template<typename T, typename Executor>
+inline auto fromFuture(std::future<T> future, Executor executor) {
+    return internal::bridge_future<T>(std::make_shared<std::future<T>>(std::move(future)), std::move(executor));
+}
+
+template<typename T, typename Executor>
+inline auto fromFuture(std::shared_future<T> future, Executor executor) {
+    return internal::bridge_future<T>(std::make_shared<std::shared_future<T>>(std::move(future)), std::move(executor));
+}
+
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "actor.hpp"
+#include "promise.hpp"
+
+namespace promise {
+
+namespace internal {
+
+struct LaneState {};
+
+template<typename Executor>
+using Lane = ActorCore<LaneState, Executor>;
+
+}
+
+// Runs its tasks on one serial lane of a KeyedLanes. Promises created with
+// it copy it into every continuation, so a whole chain stays on its key's
+// lane. Each copy shares ownership of the lane, so chains may outlive the
+// KeyedLanes that handed it out.
+template<typename Executor>
+struct KeyedExecutor {
+    std::shared_ptr<internal::Lane<Executor>> lane;
+
+    template<typename F>
+    inline void operator()(F f) const {
+        lane->post([f = std::move(f)](internal::LaneState&) mutable {
+            f();
+        });
+    }
+
+    // Lanes run on the underlying executor's threads, so a lane task that
+    // waits helps with that executor's queue.
+    template<typename E = Executor, typename = std::enable_if_t<internal::executor_helping<E>::value>>
+    bool help() const {
+        return lane->executor().help();
+    }
+
+    template<typename E = Executor, typename = std::enable_if_t<internal::executor_helping<E>::value>>
+    bool owns_current_thread() const {
+        return lane->executor().owns_current_thread();
+    }
+
+    bool operator==(const KeyedExecutor& other) const {
+        return lane == other.lane;
+    }
+
+    bool operator!=(const KeyedExecutor& other) const {
+        return lane != other.lane;
+    }
+};
+
+// A fixed set of serial lanes over an executor. A key (an account ID, a
+// session) hashes to one lane, so everything posted for a key runs in order
+// and one at a time, while keys on other lanes run in parallel. Keys that
+// share a lane also share its order; nothing is allocated per key.
+template<typename Executor>
+class KeyedLanes {
+public:
+    explicit KeyedLanes(
+        Executor executor,
+        std::size_t lanes = 4 * std::max(1u, std::thread::hardware_concurrency()),
+        std::size_t batch = 64
+    ) {
+        for (std::size_t i = 0; i < std::max<std::size_t>(lanes, 1); ++i) {
+            _lanes.push_back(std::make_shared<internal::Lane<Executor>>(internal::LaneState{}, executor, batch));
+        }
+    }
+
+    KeyedLanes(const KeyedLanes&) = delete;
+    KeyedLanes& operator=(const KeyedLanes&) = delete;
+
+    template<typename Key>
+    KeyedExecutor<Executor> executor(const Key& key) const {
+        return KeyedExecutor<Executor>{_lanes[lane_of(std::hash<Key>()(key))]};
+    }
+
+    std::size_t size() const {
+        return _lanes.size();
+    }
+
+private:
+    // std::hash is the identity for integers on common implementations;
+    // mix it so sequential keys spread over all lanes.
+    std::size_t lane_of(std::size_t hash) const {
+        auto mixed = static_cast<std::uint64_t>(hash) * 0x9e3779b97f4a7c15ull;
+        return static_cast<std::size_t>((mixed >> 32) % _lanes.size());
+    }
+
+    std::vector<std::shared_ptr<internal::Lane<Executor>>> _lanes;
+};
+
+}
@@ -0,0 +1,425 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "promise.hpp"
+
+namespace promise {
+
+// Turns a memoized value into bytes and back. Provided for std::string and
+// trivially copyable types; specialize it for anything else.
+template<typename T, typename = void>
+struct MemoCodec;
+
+template<>
+struct MemoCodec<std::string> {
+    static std::string encode(const std::string& value) {
+        return value;
+    }
+
+    static std::string decode(std::string_view bytes) {
+        return std::string(bytes);
+    }
+};
+
+template<typename T>
+struct MemoCodec<T, std::enable_if_t<std::is_trivially_copyable_v<T>>> {
+    static std::string encode(const T& value) {
+        return std::string(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    static T decode(std::string_view bytes) {
+        if (bytes.size() != sizeof(T)) {
+            throw std::runtime_error("memo record has the wrong size");
+        }
+        T value;
+        std::memcpy(&value, bytes.data(), sizeof(T));
+        return value;
+    }
+};
+
+namespace internal {
+
+// Append-only file of (key, value) records, mapped read-only. Each record
+// is u32 key size, u32 value size, u64 FNV-1a of key and value, key, value.
+// A torn tail left by a crash fails its checksum and is cut off on open.
+class MemoFile {
+public:
+    static constexpr char magic[8] = {'P', 'C', 'M', 'E', 'M', 'O', '0', '1'};
+    static constexpr std::size_t record_header = 16;
+
+    explicit MemoFile(const std::string& path) {
+        _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (_fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+        try {
+            if (::flock(_fd, LOCK_EX | LOCK_NB) != 0) {
+                throw std::system_error(errno, std::generic_category(), "flock " + path);
+            }
+            load(path);
+        } catch (...) {
+            close();
+            throw;
+        }
+    }
+
+    MemoFile(const MemoFile&) = delete;
+    MemoFile& operator=(const MemoFile&) = delete;
+
+    ~MemoFile() {
+        close();
+    }
+
+    // Calls fn with the stored bytes for key, under a shared lock.
+    template<typename Fn>
+    bool read(const std::string& key, Fn&& fn) const {
+        std::shared_lock<std::shared_mutex> lock(_mtx);
+        auto it = _index.find(key);
+        if (it == _index.end()) {
+            return false;
+        }
+        fn(std::string_view(_data + it->second.first, it->second.second));
+        return true;
+    }
+
+    void append(const std::string& key, const std::string& value) {
+        std::string record(record_header, '\0');
+        std::uint32_t sizes[2] = {static_cast<std::uint32_t>(key.size()), static_cast<std::uint32_t>(value.size())};
+        auto sum = checksum(key, value);
+        std::memcpy(&record[0], sizes, sizeof(sizes));
+        std::memcpy(&record[8], &sum, sizeof(sum));
+        record += key;
+        record += value;
+
+        std::lock_guard<std::mutex> writer(_append_mtx);
+        for (std::size_t written = 0; written < record.size();) {
+            auto n = ::pwrite(_fd, record.data() + written, record.size() - written, static_cast<off_t>(_end + written));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "pwrite");
+            }
+            written += static_cast<std::size_t>(n);
+        }
+
+        std::unique_lock<std::shared_mutex> lock(_mtx);
+        remap(_end + record.size());
+        _index[key] = {_end + record_header + key.size(), value.size()};
+        _end += record.size();
+    }
+
+    std::size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(_mtx);
+        return _index.size();
+    }
+
+private:
+    static std::uint64_t checksum(std::string_view key, std::string_view value) {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (auto part : {key, value}) {
+            for (unsigned char c : part) {
+                hash = (hash ^ c) * 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+
+    void load(const std::string& path) {
+        struct stat st;
+        if (::fstat(_fd, &st) != 0) {
+            throw std::system_error(errno, std::generic_category(), "fstat " + path);
+        }
+
+        auto size = static_cast<std::size_t>(st.st_size);
+        if (size == 0) {
+            if (::pwrite(_fd, magic, sizeof(magic), 0) != static_cast<ssize_t>(sizeof(magic))) {
+                throw std::system_error(errno, std::generic_category(), "pwrite " + path);
+            }
+            size = sizeof(magic);
+        }
+
+        remap(size);
+        if (std::memcmp(_data, magic, sizeof(magic)) != 0) {
+            throw std::runtime_error(path + " is not a memo file");
+        }
+
+        std::size_t offset = sizeof(magic);
+        while (size - offset >= record_header) {
+            std::uint32_t sizes[2];
+            std::uint64_t sum;
+            std::memcpy(sizes, _data + offset, sizeof(sizes));
+            std::memcpy(&sum, _data + offset + 8, sizeof(sum));
+
+            auto body = std::size_t(sizes[0]) + sizes[1];
+            if (size - offset - record_header < body) {
+                break;
+            }
+            std::string_view key(_data + offset + record_header, sizes[0]);
+            std::string_view value(key.data() + key.size(), sizes[1]);
+            if (checksum(key, value) != sum) {
+                break;
+            }
+
+            _index[std::string(key)] = {offset + record_header + key.size(), value.size()};
+            offset += record_header + body;
+        }
+
+        if (offset != size && ::ftruncate(_fd, static_cast<off_t>(offset)) != 0) {
+            throw std::system_error(errno, std::generic_category(), "ftruncate " + path);
+        }
+        _end = offset;
+    }
+
+    // Called with the exclusive lock held, or before anyone can read. The
+    // mapping at least doubles, so appends pay for an mremap only now and
+    // then; the part past the end of the file is never read, since _index
+    // points below _end.
+    void remap(std::size_t needed) {
+        if (needed <= _mapped) {
+            return;
+        }
+        auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        auto size = std::max(needed, _mapped * 2);
+        size = (size + page - 1) / page * page;
+        void* data = _data
+            ? ::mremap(const_cast<char*>(_data), _mapped, size, MREMAP_MAYMOVE)
+            : ::mmap(nullptr, size, PROT_READ, MAP_SHARED, _fd, 0);
+        if (data == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "mmap");
+        }
+        _data = static_cast<const char*>(data);
+        _mapped = size;
+    }
+
+    void close() {
+        if (_data) {
+            ::munmap(const_cast<char*>(_data), _mapped);
+        }
+        ::close(_fd);
+    }
+
+    int _fd = -1;
+    const char* _data = nullptr;
+    std::size_t _mapped = 0;
+    std::size_t _end = 0;
+
+    mutable std::shared_mutex _mtx;
+    std::unordered_map<std::string, std::pair<std::size_t, std::size_t>> _index;
+    std::mutex _append_mtx;
+};
+
+template<typename T, typename Executor, typename Codec>
+class MemoCore : public std::enable_shared_from_this<MemoCore<T, Executor, Codec>> {
+public:
+    MemoCore(const std::string& path, Executor executor) : _file(path), _executor(std::move(executor)) {}
+
+    template<typename Factory>
+    Promise<T, Executor> get(const std::string& key, Factory factory) {
+        if (auto value = lookup(key)) {
+            return Promise<T, Executor>::resolve(std::move(*value), _executor);
+        }
+
+        std::shared_ptr<Flight> flight;
+        bool leader = false;
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            auto& slot = _flights[key];
+            if (!slot) {
+                // It may have been stored since the lookup above.
+                if (auto value = lookup(key)) {
+                    _flights.erase(key);
+                    return Promise<T, Executor>::resolve(std::move(*value), _executor);
+                }
+                slot = std::make_shared<Flight>();
+                leader = true;
+            }
+            flight = slot;
+        }
+
+        return usePromise<T>([self = this->shared_from_this(), key, flight, leader, factory = std::move(factory)](auto resolve, auto reject) {
+            join(*flight, resolve, reject);
+            if (!leader) {
+                return;
+            }
+
+            try {
+                if constexpr (is_promise_v<std::invoke_result_t<const Factory&>>) {
+                    factory().then([self, key, flight](T value) {
+                        self->finish(key, *flight, std::move(value));
+                    }, [self, key, flight](std::exception_ptr error) {
+                        self->fail(key, *flight, error);
+                    });
+                } else {
+                    self->finish(key, *flight, factory());
+                }
+            } catch (...) {
+                self->fail(key, *flight, std::current_exception());
+            }
+        }, _executor);
+    }
+
+    std::size_t size() const {
+        return _file.size();
+    }
+
+private:
+    struct Flight {
+        std::mutex mtx;
+        bool done = false;
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::vector<std::function<void(T)>> resolvers;
+        std::vector<std::function<void(std::exception_ptr)>> rejecters;
+    };
+
+    // Records that no longer decode are treated as missing and recomputed.
+    std::optional<T> lookup(const std::string& key) const {
+        std::optional<T> value;
+        try {
+            _file.read(key, [&](std::string_view bytes) {
+                value.emplace(Codec::decode(bytes));
+            });
+        } catch (...) {
+            value.reset();
+        }
+        return value;
+    }
+
+    template<typename Resolve, typename Reject>
+    static void join(Flight& flight, Resolve& resolve, Reject& reject) {
+        std::unique_lock<std::mutex> lock(flight.mtx);
+        if (!flight.done) {
+            flight.resolvers.push_back(resolve);
+            flight.rejecters.push_back(reject);
+            return;
+        }
+        lock.unlock();
+
+        if (flight.error) {
+            reject(flight.error);
+        } else {
+            resolve(*flight.value);
+        }
+    }
+
+    // The flight stays registered until the record is on disk, so lookups
+    // in between join it instead of starting the factory again.
+    void finish(const std::string& key, Flight& flight, T value) {
+        std::string bytes;
+        try {
+            bytes = Codec::encode(value);
+        } catch (...) {
+            fail(key, flight, std::current_exception());
+            return;
+        }
+
+        std::vector<std::function<void(T)>> resolvers;
+        {
+            std::lock_guard<std::mutex> lock(flight.mtx);
+            flight.done = true;
+            flight.value.emplace(value);
+            resolvers.swap(flight.resolvers);
+            flight.rejecters.clear();
+        }
+        for (auto& resolve : resolvers) {
+            resolve(value);
+        }
+
+        _executor([self = this->shared_from_this(), key, bytes = std::move(bytes)] {
+            try {
+                self->_file.append(key, bytes);
+            } catch (...) {
+                // Still cached in the flight for this process; it will be
+                // recomputed after a restart.
+                return;
+            }
+            std::lock_guard<std::mutex> lock(self->_mtx);
+            self->_flights.erase(key);
+        });
+    }
+
+    void fail(const std::string& key, Flight& flight, std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _flights.erase(key);
+        }
+
+        std::vector<std::function<void(std::exception_ptr)>> rejecters;
+        {
+            std::lock_guard<std::mutex> lock(flight.mtx);
+            flight.done = true;
+            flight.error = error;
+            rejecters.swap(flight.rejecters);
+            flight.resolvers.clear();
+        }
+        for (auto& reject : rejecters) {
+            reject(error);
+        }
+    }
+
+    MemoFile _file;
+    Executor _executor;
+
+    std::mutex _mtx;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> _flights;
+};
+
+}
+
+// Memoizes expensive results across restarts in an append-only file mapped
+// into memory. get() returns an already settled promise when the key is
+// stored; otherwise the factory (returning T or a Promise of T) runs once
+// however many lookups arrive meanwhile, and its result is appended to the
+// file on the executor. Failures are not stored. The file is locked to one
+// process at a time.
+template<typename T, typename Executor, typename Codec = MemoCodec<T>>
+class DiskMemo {
+public:
+    explicit DiskMemo(const std::string& path, Executor executor = Executor())
+        : _core(std::make_shared<internal::MemoCore<T, Executor, Codec>>(path, std::move(executor))) {}
+
+    template<typename Factory>
+    Promise<T, Executor> get(const std::string& key, Factory factory) {
+        return _core->get(key, std::move(factory));
+    }
+
+    // Records on disk.
+    std::size_t size() const {
+        return _core->size();
+    }
+
+private:
+    std::shared_ptr<internal::MemoCore<T, Executor, Codec>> _core;
+};
+
+}
+
+#endif
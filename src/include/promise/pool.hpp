@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+namespace promise {
+
+// Fixed-capacity block pool for real-time paths. All memory is reserved up
+// front, allocate/deallocate are lock-free and run in bounded time, and a
+// request that does not fit a block or finds the pool empty throws
+// std::bad_alloc instead of falling back to the heap. Blocks start on cache
+// line boundaries, so neighbouring blocks never share a line.
+class FixedPool {
+public:
+    FixedPool(std::size_t block_size, std::size_t capacity)
+        : _block_size(checked_block_size(block_size, capacity)),
+          _capacity(capacity),
+          _blocks(static_cast<std::byte*>(::operator new(_block_size * capacity, std::align_val_t(block_alignment)))),
+          _next(new std::atomic<std::uint32_t>[capacity]) {
+        for (std::size_t i = 0; i < capacity; ++i) {
+            _next[i].store(i + 1 < capacity ? static_cast<std::uint32_t>(i + 1) : npos, std::memory_order_relaxed);
+        }
+        _head.store(capacity ? 0 : npos, std::memory_order_release);
+    }
+
+    FixedPool(const FixedPool&) = delete;
+    FixedPool& operator=(const FixedPool&) = delete;
+
+    void* allocate(std::size_t bytes) {
+        if (bytes > _block_size) {
+            throw std::bad_alloc();
+        }
+
+        auto head = _head.load(std::memory_order_acquire);
+        while (true) {
+            auto index = static_cast<std::uint32_t>(head);
+            if (index == npos) {
+                throw std::bad_alloc();
+            }
+
+            auto next = with_tag(head, _next[index].load(std::memory_order_relaxed));
+            if (_head.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire)) {
+                _used.fetch_add(1, std::memory_order_relaxed);
+                return _blocks.get() + index * _block_size;
+            }
+        }
+    }
+
+    void deallocate(void* p) noexcept {
+        auto index = static_cast<std::uint32_t>((static_cast<std::byte*>(p) - _blocks.get()) / _block_size);
+
+        auto head = _head.load(std::memory_order_relaxed);
+        while (true) {
+            _next[index].store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+            if (_head.compare_exchange_weak(head, with_tag(head, index), std::memory_order_release, std::memory_order_relaxed)) {
+                _used.fetch_sub(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+    }
+
+    std::size_t block_size() const noexcept { return _block_size; }
+    std::size_t capacity() const noexcept { return _capacity; }
+    std::size_t used() const noexcept { return _used.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr std::uint32_t npos = UINT32_MAX;
+    static constexpr std::size_t block_alignment = 64;
+
+    struct AlignedDelete {
+        void operator()(std::byte* p) const noexcept {
+            ::operator delete(p, std::align_val_t(block_alignment));
+        }
+    };
+
+    static std::size_t round_up(std::size_t size) {
+        return (size + block_alignment - 1) / block_alignment * block_alignment;
+    }
+
+    // Runs before anything is allocated.
+    static std::size_t checked_block_size(std::size_t block_size, std::size_t capacity) {
+        if (block_size == 0) {
+            throw std::invalid_argument("FixedPool blocks must not be empty");
+        }
+        constexpr auto max = std::numeric_limits<std::size_t>::max();
+        if (capacity >= npos || block_size > max - block_alignment + 1) {
+            throw std::bad_alloc();
+        }
+        auto rounded = round_up(block_size);
+        if (capacity && rounded > max / capacity) {
+            throw std::bad_alloc();
+        }
+        return rounded;
+    }
+
+    // The upper half of the head is bumped on every change so a block that
+    // is popped and pushed back between a load and a CAS is not mistaken for
+    // an unchanged list.
+    static std::uint64_t with_tag(std::uint64_t head, std::uint32_t index) {
+        return (((head >> 32) + 1) << 32) | index;
+    }
+
+    std::size_t _block_size;
+    std::size_t _capacity;
+    std::unique_ptr<std::byte, AlignedDelete> _blocks;
+    std::unique_ptr<std::atomic<std::uint32_t>[]> _next;
+    std::atomic<std::uint64_t> _head{npos};
+    std::atomic<std::size_t> _used{0};
+};
+
+// Standard allocator over a FixedPool, for executors that expose
+// `allocator_type` and `get_allocator()` to the promise machinery.
+template<typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+    // Executors that hand out this allocator get lock-free shared states.
+    using lock_free = std::true_type;
+
+    explicit PoolAllocator(FixedPool& pool) noexcept : _pool(&pool) {}
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>& other) noexcept : _pool(other._pool) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(_pool->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+        _pool->deallocate(p);
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U>& other) const noexcept { return _pool == other._pool; }
+
+    template<typename U>
+    bool operator!=(const PoolAllocator<U>& other) const noexcept { return _pool != other._pool; }
+
+private:
+    template<typename>
+    friend class PoolAllocator;
+
+    FixedPool* _pool;
+};
+
+}
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace promise {
+
+// Where a promise was created, captured through a defaulted argument.
+struct CallSite {
+    const char* file = "";
+    unsigned line = 0;
+
+    static constexpr CallSite current(
+        const char* file = __builtin_FILE(),
+        unsigned line = __builtin_LINE()
+    ) noexcept {
+        return CallSite{file, line};
+    }
+};
+
+namespace profile {
+
+// Log2 buckets of nanoseconds: bucket i counts samples in [2^(i-1), 2^i).
+using Histogram = std::array<std::uint64_t, 40>;
+
+struct SiteReport {
+    CallSite site;
+    std::uint64_t acquisitions = 0;
+    std::uint64_t contended = 0;
+    Histogram wait{};
+    Histogram hold{};
+};
+
+namespace internal {
+
+inline std::size_t bucket(std::uint64_t ns) {
+    std::size_t i = 0;
+    while (ns && i + 1 < std::tuple_size_v<Histogram>) {
+        ns >>= 1;
+        ++i;
+    }
+    return i;
+}
+
+inline std::uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+struct SiteStats {
+    CallSite site;
+    std::atomic<std::uint64_t> acquisitions{0};
+    std::atomic<std::uint64_t> contended{0};
+    std::array<std::atomic<std::uint64_t>, std::tuple_size_v<Histogram>> wait{};
+    std::array<std::atomic<std::uint64_t>, std::tuple_size_v<Histogram>> hold{};
+
+    void record_wait(std::uint64_t ns) {
+        acquisitions.fetch_add(1, std::memory_order_relaxed);
+        if (ns) {
+            contended.fetch_add(1, std::memory_order_relaxed);
+        }
+        wait[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void record_hold(std::uint64_t ns) {
+        hold[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+class Registry {
+public:
+    static Registry& instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    // Called for every new state, so a site seen before is found without a
+    // lock: by its file pointer and line, in an insert-only open-addressed
+    // table. Only a site's first state (or a full table) takes the mutex.
+    SiteStats* find(CallSite site) {
+        auto hash = (reinterpret_cast<std::uintptr_t>(site.file) >> 3) * 0x9e3779b97f4a7c15ull + site.line;
+        for (std::size_t probe = 0; probe < max_probes; ++probe) {
+            auto& slot = _cache[(hash + probe) & (cache_size - 1)];
+            auto entry = slot.load(std::memory_order_acquire);
+            if (!entry) {
+                entry = insert(site);
+                CacheEntry* expected = nullptr;
+                if (slot.compare_exchange_strong(expected, entry, std::memory_order_acq_rel)) {
+                    return entry->stats;
+                }
+                entry = expected;
+            }
+            if (entry->file == site.file && entry->line == site.line) {
+                return entry->stats;
+            }
+        }
+        return insert(site)->stats;
+    }
+
+    std::vector<SiteReport> snapshot() {
+        std::vector<SiteReport> reports;
+        std::lock_guard<std::mutex> lock(_mtx);
+        for (auto& [key, stats] : _sites) {
+            SiteReport report;
+            report.site = stats->site;
+            report.acquisitions = stats->acquisitions.load(std::memory_order_relaxed);
+            report.contended = stats->contended.load(std::memory_order_relaxed);
+            for (std::size_t i = 0; i < report.wait.size(); ++i) {
+                report.wait[i] = stats->wait[i].load(std::memory_order_relaxed);
+                report.hold[i] = stats->hold[i].load(std::memory_order_relaxed);
+            }
+            reports.push_back(report);
+        }
+        return reports;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(_mtx);
+        for (auto& [key, stats] : _sites) {
+            stats->acquisitions = 0;
+            stats->contended = 0;
+            for (std::size_t i = 0; i < stats->wait.size(); ++i) {
+                stats->wait[i] = 0;
+                stats->hold[i] = 0;
+            }
+        }
+    }
+
+private:
+    struct CacheEntry {
+        const char* file;
+        unsigned line;
+        SiteStats* stats;
+    };
+
+    static constexpr std::size_t cache_size = 4096;
+    static constexpr std::size_t max_probes = 16;
+
+    // The same file may reach us through different pointers, so sites are
+    // keyed by name here; entries are never freed.
+    CacheEntry* insert(CallSite site) {
+        std::lock_guard<std::mutex> lock(_mtx);
+        auto& stats = _sites[{std::string(site.file), site.line}];
+        if (!stats) {
+            stats = std::make_unique<SiteStats>();
+            stats->site = site;
+        }
+        _entries.push_back(std::make_unique<CacheEntry>(CacheEntry{site.file, site.line, stats.get()}));
+        return _entries.back().get();
+    }
+
+    std::array<std::atomic<CacheEntry*>, cache_size> _cache{};
+
+    std::mutex _mtx;
+    std::map<std::pair<std::string, unsigned>, std::unique_ptr<SiteStats>> _sites;
+    std::vector<std::unique_ptr<CacheEntry>> _entries;
+};
+
+}
+
+// Drop-in replacement for the shared-state mutex that records how long each
+// acquisition waited and how long the lock was held, attributed to the site
+// that created the promise.
+class ProfiledMutex {
+public:
+    void attach(CallSite site) {
+        _stats = internal::Registry::instance().find(site);
+    }
+
+    void lock() {
+        std::uint64_t wait = 0;
+        if (!_mtx.try_lock()) {
+            auto start = internal::now();
+            _mtx.lock();
+            wait = internal::now() - start;
+        }
+
+        _acquired = internal::now();
+        if (_stats) {
+            _stats->record_wait(wait);
+        }
+    }
+
+    bool try_lock() {
+        if (!_mtx.try_lock()) {
+            return false;
+        }
+
+        _acquired = internal::now();
+        if (_stats) {
+            _stats->record_wait(0);
+        }
+        return true;
+    }
+
+    void unlock() {
+        auto hold = internal::now() - _acquired;
+        auto stats = _stats;
+        _mtx.unlock();
+        if (stats) {
+            stats->record_hold(hold);
+        }
+    }
+
+private:
+    std::mutex _mtx;
+    internal::SiteStats* _stats = nullptr;
+    std::uint64_t _acquired = 0;
+};
+
+inline std::vector<SiteReport> snapshot() {
+    return internal::Registry::instance().snapshot();
+}
+
+inline void reset() {
+    internal::Registry::instance().reset();
+}
+
+inline void dump(std::ostream& out) {
+    for (const auto& report : snapshot()) {
+        out << report.site.file << ':' << report.site.line
+            << " acquisitions=" << report.acquisitions
+            << " contended=" << report.contended << '\n';
+
+        for (std::size_t i = 0; i < report.wait.size(); ++i) {
+            if (report.wait[i] || report.hold[i]) {
+                out << "  <" << (std::uint64_t(1) << i) << "ns"
+                    << " wait=" << report.wait[i]
+                    << " hold=" << report.hold[i] << '\n';
+            }
+        }
+    }
+}
+
+}
+
+namespace internal {
+
+#if defined(PROMISE_CC_PROFILE_LOCKS)
+using StateMutex = profile::ProfiledMutex;
+#else
+using StateMutex = std::mutex;
+#endif
+
+}
+
+}
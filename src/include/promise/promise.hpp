@@ -1,17 +1,34 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <optional>
+#include <stdexcept>
 #include <type_traits>
-#include <vector>
+#include <utility>
 #include <exception>
 
+#include "budget.hpp"
+#include "cost.hpp"
+#include "execution.hpp"
+#include "profile.hpp"
+#include "trace.hpp"
+
 namespace promise {
 
+// Settles promises whose continuation was unsubscribed before it ran.
+class Cancelled : public std::runtime_error {
+public:
+    Cancelled() : std::runtime_error("promise cancelled") {}
+};
+
 namespace internal {
 
 template<typename T, typename Executor>
@@ -39,35 +56,657 @@ template<typename T>
 using promise_value_type_t = typename promise_value_type<T>::type;
 
 
-enum class PromiseState {
+enum class PromiseState : std::uint8_t {
     PENDING,
     FULFILLED,
     REJECTED
 };
 
 
+template<typename Executor>
+struct Continuation;
+
+// Reference counts of a core-local state: plain integers, kept in the same
+// allocation as the state itself. All strong references together hold one
+// weak reference, so the block outlives the state while weak ones remain.
+struct LocalCount {
+    std::size_t strong = 1;
+    std::size_t weak = 1;
+
+    virtual void destroy() noexcept = 0;
+    virtual void deallocate() noexcept = 0;
+
+    void release() noexcept {
+        if (--strong == 0) {
+            destroy();
+            release_weak();
+        }
+    }
+
+    void release_weak() noexcept {
+        if (--weak == 0) {
+            deallocate();
+        }
+    }
+
+protected:
+    ~LocalCount() = default;
+};
+
+template<typename T, typename Allocator>
+struct LocalBlock final : LocalCount {
+    using BlockAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<LocalBlock>;
+
+    template<typename... Args>
+    LocalBlock(const Allocator& allocator, Args&&... args) : allocator(allocator) {
+        ::new (static_cast<void*>(&storage)) T(std::forward<Args>(args)...);
+    }
+
+    T* get() noexcept {
+        return std::launder(reinterpret_cast<T*>(&storage));
+    }
+
+    void destroy() noexcept override {
+        get()->~T();
+    }
+
+    void deallocate() noexcept override {
+        BlockAllocator block_allocator(std::move(allocator));
+        this->~LocalBlock();
+        std::allocator_traits<BlockAllocator>::deallocate(block_allocator, this, 1);
+    }
+
+    BlockAllocator allocator;
+    alignas(T) unsigned char storage[sizeof(T)];
+};
+
+template<typename T>
+class LocalWeakPtr;
+
+// The subset of std::shared_ptr the promise machinery uses, over a
+// LocalCount. Copies must stay on the thread that made the state.
+template<typename T>
+class LocalPtr {
+public:
+    using element_type = T;
+
+    LocalPtr() noexcept = default;
+    LocalPtr(std::nullptr_t) noexcept {}
+
+    LocalPtr(const LocalPtr& other) noexcept : _ptr(other._ptr), _count(other._count) {
+        retain();
+    }
+
+    LocalPtr(LocalPtr&& other) noexcept
+        : _ptr(std::exchange(other._ptr, nullptr)), _count(std::exchange(other._count, nullptr)) {}
+
+    template<typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+    LocalPtr(const LocalPtr<U>& other) noexcept : _ptr(other._ptr), _count(other._count) {
+        retain();
+    }
+
+    template<typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+    LocalPtr(LocalPtr<U>&& other) noexcept
+        : _ptr(std::exchange(other._ptr, nullptr)), _count(std::exchange(other._count, nullptr)) {}
+
+    // Shares other's count but points at ptr; from an empty other, the
+    // result does not own ptr at all.
+    template<typename U>
+    LocalPtr(const LocalPtr<U>& other, T* ptr) noexcept : _ptr(ptr), _count(other._count) {
+        retain();
+    }
+
+    ~LocalPtr() {
+        if (_count) {
+            _count->release();
+        }
+    }
+
+    LocalPtr& operator=(LocalPtr other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    void swap(LocalPtr& other) noexcept {
+        std::swap(_ptr, other._ptr);
+        std::swap(_count, other._count);
+    }
+
+    void reset() noexcept {
+        LocalPtr().swap(*this);
+    }
+
+    T* get() const noexcept { return _ptr; }
+    T& operator*() const noexcept { return *_ptr; }
+    T* operator->() const noexcept { return _ptr; }
+    explicit operator bool() const noexcept { return _ptr != nullptr; }
+
+    long use_count() const noexcept {
+        return _count ? static_cast<long>(_count->strong) : 0;
+    }
+
+    template<typename Allocator, typename... Args>
+    static LocalPtr allocate(const Allocator& allocator, Args&&... args) {
+        using Block = LocalBlock<T, Allocator>;
+        using Traits = std::allocator_traits<typename Block::BlockAllocator>;
+
+        typename Block::BlockAllocator block_allocator(allocator);
+        auto block = Traits::allocate(block_allocator, 1);
+        try {
+            ::new (static_cast<void*>(block)) Block(allocator, std::forward<Args>(args)...);
+        } catch (...) {
+            Traits::deallocate(block_allocator, block, 1);
+            throw;
+        }
+        return LocalPtr(block->get(), block);
+    }
+
+private:
+    template<typename>
+    friend class LocalPtr;
+
+    template<typename>
+    friend class LocalWeakPtr;
+
+    // Adopts a reference the caller already counted.
+    LocalPtr(T* ptr, LocalCount* count) noexcept : _ptr(ptr), _count(count) {}
+
+    void retain() noexcept {
+        if (_count) {
+            ++_count->strong;
+        }
+    }
+
+    T* _ptr = nullptr;
+    LocalCount* _count = nullptr;
+};
+
+template<typename T>
+class LocalWeakPtr {
+public:
+    LocalWeakPtr() noexcept = default;
+
+    LocalWeakPtr(const LocalWeakPtr& other) noexcept : _ptr(other._ptr), _count(other._count) {
+        retain();
+    }
+
+    LocalWeakPtr(LocalWeakPtr&& other) noexcept
+        : _ptr(std::exchange(other._ptr, nullptr)), _count(std::exchange(other._count, nullptr)) {}
+
+    template<typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+    LocalWeakPtr(const LocalPtr<U>& other) noexcept : _ptr(other._ptr), _count(other._count) {
+        retain();
+    }
+
+    ~LocalWeakPtr() {
+        if (_count) {
+            _count->release_weak();
+        }
+    }
+
+    LocalWeakPtr& operator=(LocalWeakPtr other) noexcept {
+        std::swap(_ptr, other._ptr);
+        std::swap(_count, other._count);
+        return *this;
+    }
+
+    void reset() noexcept {
+        *this = LocalWeakPtr();
+    }
+
+    LocalPtr<T> lock() const noexcept {
+        if (!_count || _count->strong == 0) {
+            return {};
+        }
+        ++_count->strong;
+        return LocalPtr<T>(_ptr, _count);
+    }
+
+private:
+    void retain() noexcept {
+        if (_count) {
+            ++_count->weak;
+        }
+    }
+
+    T* _ptr = nullptr;
+    LocalCount* _count = nullptr;
+};
+
+// Handles to shared states. States of executors that declare
+// `using core_local = std::true_type;` never change threads, so their
+// reference counts are plain integers, not atomics.
+template<typename Executor, typename = void>
+struct state_handle {
+    template<typename T>
+    using ptr = std::shared_ptr<T>;
+
+    template<typename T>
+    using weak = std::weak_ptr<T>;
+
+    template<typename T, typename Allocator, typename... Args>
+    static ptr<T> make(const Allocator& allocator, Args&&... args) {
+        return std::allocate_shared<T>(allocator, std::forward<Args>(args)...);
+    }
+};
+
+template<typename Executor>
+struct state_handle<Executor, std::enable_if_t<Executor::core_local::value>> {
+    template<typename T>
+    using ptr = LocalPtr<T>;
+
+    template<typename T>
+    using weak = LocalWeakPtr<T>;
+
+    template<typename T, typename Allocator, typename... Args>
+    static ptr<T> make(const Allocator& allocator, Args&&... args) {
+        return LocalPtr<T>::allocate(allocator, std::forward<Args>(args)...);
+    }
+};
+
+template<typename T, typename Executor>
+using StatePtr = typename state_handle<Executor>::template ptr<T>;
+
+template<typename T, typename Executor>
+using WeakStatePtr = typename state_handle<Executor>::template weak<T>;
+
+template<typename Executor>
+using ContinuationPtr = StatePtr<Continuation<Executor>, Executor>;
+
+// A continuation is linked straight into its parent's callback list, so
+// attaching one needs no allocation beyond its own shared state. The back
+// link lets a subscription unlink it in O(1) while the parent is pending.
+template<typename Executor>
+struct Continuation {
+    virtual ~Continuation() = default;
+    virtual void run(ContinuationPtr<Executor> self) = 0;
+    virtual void cancel() = 0;
+
+    ContinuationPtr<Executor> next_callback;
+    Continuation* prev_callback = nullptr;
+    bool linked = false;
+    // Lock-free lists (see lock_free_states) hold nodes by raw pointer: the
+    // node pushed before this one, the list's reference to this node, and
+    // whether the settling thread or an unlink took it out first.
+    Continuation* pushed_next = nullptr;
+    ContinuationPtr<Executor> pinned;
+    std::atomic<bool> claimed{false};
+    // Run by the settling thread instead of the executor; only for nodes
+    // that do a few atomic operations and return.
+    bool run_inline = false;
+};
+
+// Executors may provide `allocator_type` and `get_allocator()` to choose
+// where shared states live; all others use the default allocator.
+template<typename Executor, typename = void>
+struct executor_allocator {
+    static std::allocator<char> get(const Executor&) { return {}; }
+};
+
+template<typename Executor>
+struct executor_allocator<Executor, std::void_t<typename Executor::allocator_type>> {
+    static typename Executor::allocator_type get(const Executor& executor) { return executor.get_allocator(); }
+};
+
+// Executors may provide `get_budget()` returning a promise::Budget* to have
+// their states' memory accounted for and root promises admitted against it.
+template<typename Executor, typename = void>
+struct executor_budget {
+    static constexpr bool enabled = false;
+    static Budget* get(const Executor&) { return nullptr; }
+};
+
+template<typename Executor>
+struct executor_budget<Executor, std::void_t<decltype(std::declval<const Executor&>().get_budget())>> {
+    static constexpr bool enabled = true;
+    static Budget* get(const Executor& executor) { return executor.get_budget(); }
+};
+
+// Executors of the built-in pools provide `bool help() const`, which runs
+// queued work on the calling thread when it is one of the pool's own, and
+// `bool owns_current_thread() const`, which tells whether it is.
+template<typename Executor, typename = void>
+struct executor_helping : std::false_type {};
+
+template<typename Executor>
+struct executor_helping<Executor, std::void_t<
+    decltype(std::declval<const Executor&>().help()),
+    decltype(std::declval<const Executor&>().owns_current_thread())
+>> : std::true_type {};
+
+// A pool thread waiting for room runs the pool's queued work meanwhile, or
+// it could be waiting for continuations queued behind itself to free it.
+template<typename Executor>
+inline bool admit(Budget& budget, const Executor& executor) {
+    if constexpr (executor_helping<Executor>::value) {
+        return budget.admit([&executor] { return executor.help(); });
+    } else {
+        return budget.admit();
+    }
+}
+
+template<typename State, typename Executor, typename... Args>
+inline StatePtr<State, Executor> allocate_state(const Executor& executor, Args&&... args) {
+    auto allocator = executor_allocator<Executor>::get(executor);
+    if constexpr (executor_budget<Executor>::enabled) {
+        if (auto budget = executor_budget<Executor>::get(executor)) {
+            using Allocator = BudgetAllocator<typename decltype(allocator)::value_type, decltype(allocator)>;
+            return state_handle<Executor>::template make<State>(Allocator(*budget, allocator), executor, std::forward<Args>(args)...);
+        }
+    }
+    return state_handle<Executor>::template make<State>(allocator, executor, std::forward<Args>(args)...);
+}
+
+struct NullMutex {
+    void lock() {}
+    bool try_lock() { return true; }
+    void unlock() {}
+};
+
+template<typename Executor, typename = void>
+struct is_core_local : std::false_type {};
+
+template<typename Executor>
+struct is_core_local<Executor, std::enable_if_t<Executor::core_local::value>> : std::true_type {};
+
+// Allocators that never block, like PoolAllocator, declare
+// `using lock_free = std::true_type;`. States they allocate keep their
+// callback list in one atomic word instead of behind the state lock, so
+// then(), settling and dispatch never block either.
+template<typename Executor, typename = void>
+struct lock_free_states : std::false_type {};
+
+template<typename Executor>
+struct lock_free_states<Executor, std::enable_if_t<Executor::allocator_type::lock_free::value && !is_core_local<Executor>::value>>
+    : std::true_type {};
+
+// Executors whose continuations never leave one thread can declare
+// `using core_local = std::true_type;` to drop the shared-state lock.
+template<typename Executor, typename = void>
+struct state_mutex {
+    using type = StateMutex;
+};
+
+template<typename Executor>
+struct state_mutex<Executor, std::enable_if_t<Executor::core_local::value>> {
+    using type = NullMutex;
+};
+
+template<typename Executor>
+struct state_mutex<Executor, std::enable_if_t<lock_free_states<Executor>::value>> {
+    using type = NullMutex;
+};
+
+inline constexpr std::size_t cache_line_size = 64;
+
+// Executors can declare `using cache_aligned = std::true_type;` to start each
+// shared state and its value on separate cache lines, so a thread resolving
+// the value does not false-share with threads attaching continuations.
+template<typename Executor, typename = void>
+struct is_cache_aligned : std::false_type {};
+
+template<typename Executor>
+struct is_cache_aligned<Executor, std::enable_if_t<Executor::cache_aligned::value>> : std::true_type {};
+
+template<typename Executor, typename Member>
+inline constexpr std::size_t member_alignment = is_cache_aligned<Executor>::value
+    ? std::max(cache_line_size, alignof(Member))
+    : alignof(Member);
+
+// Rarely used per-state data, allocated only when a chain is sampled or
+// billed to a cost account. Hops of a billed chain that is not sampled
+// have nothing of their own to record, so they share one block.
+struct Diagnostics {
+    std::shared_ptr<trace::Trace> trace;
+    std::size_t trace_hop = 0;
+    std::shared_ptr<cost::Account> account;
+    std::atomic<std::size_t> owners{1};
+};
+
+struct DiagnosticsRelease {
+    void operator()(Diagnostics* diagnostics) const {
+        if (diagnostics->owners.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete diagnostics;
+        }
+    }
+};
+
 template<typename Executor>
 struct SharedStateBase {
+    using mutex_type = typename state_mutex<Executor>::type;
+    using callback_list = std::conditional_t<lock_free_states<Executor>::value, std::atomic<Continuation<Executor>*>, ContinuationPtr<Executor>>;
+
+    static constexpr bool lock_free = lock_free_states<Executor>::value;
+
     SharedStateBase(Executor executor) : executor(std::move(executor)) {}
 
-    std::mutex mtx;
+    // A pending lock-free list still holds its nodes' references.
+    ~SharedStateBase() {
+        if constexpr (lock_free) {
+            auto node = callbacks.load(std::memory_order_acquire);
+            while (node && node != settled_mark()) {
+                auto next = node->pushed_next;
+                auto pinned = std::move(node->pinned);
+                node = next;
+            }
+        }
+    }
+
+    // Touched on every hop: attach, settle and dispatch.
+    alignas(member_alignment<Executor, mutex_type>) mutex_type mtx;
     PromiseState state = PromiseState::PENDING;
-    std::optional<std::exception_ptr> exception;
-    std::vector<std::function<void()>> callbacks;
+    callback_list callbacks{};
     Executor executor;
 
-    inline void trigger_callbacks(std::vector<std::function<void()>>& callbacks) {
-        for (auto& callback : callbacks) {
-            executor(std::move(callback));
+    std::exception_ptr exception;
+    std::unique_ptr<Diagnostics, DiagnosticsRelease> diagnostics;
+
+    inline void attach_site(CallSite site) {
+#if defined(PROMISE_CC_PROFILE_LOCKS)
+        if constexpr (std::is_same_v<mutex_type, profile::ProfiledMutex>) {
+            mtx.attach(site);
+        }
+#endif
+        (void)site;
+    }
+
+    inline void start_trace() {
+        auto trace = trace::sample();
+        auto account = cost::current();
+        if (trace || account) {
+            auto hop = trace ? trace->open(trace::Trace::root) : 0;
+            diagnostics.reset(new Diagnostics{std::move(trace), hop, std::move(account)});
+        }
+    }
+
+    inline void inherit_trace(const SharedStateBase& parent) {
+        if (parent.diagnostics) {
+            auto& trace = parent.diagnostics->trace;
+            if (!trace) {
+                parent.diagnostics->owners.fetch_add(1, std::memory_order_relaxed);
+                diagnostics.reset(parent.diagnostics.get());
+                return;
+            }
+            auto hop = trace->open(parent.diagnostics->trace_hop);
+            diagnostics.reset(new Diagnostics{trace, hop, parent.diagnostics->account});
         }
     }
+
+    inline const std::shared_ptr<cost::Account>* cost_account() const {
+        return diagnostics && diagnostics->account ? &diagnostics->account : nullptr;
+    }
+
+    inline void trace_started() {
+        if (diagnostics && diagnostics->trace) {
+            diagnostics->trace->started(diagnostics->trace_hop);
+        }
+    }
+
+    inline void trace_settled() {
+        if (diagnostics && diagnostics->trace) {
+            diagnostics->trace->settled(diagnostics->trace_hop);
+        }
+    }
+
+    // Links callback while this state is pending. Returns false, leaving
+    // callback untouched, once it has settled; the caller dispatches it.
+    inline bool link_callback(ContinuationPtr<Executor>& callback) {
+        if constexpr (lock_free) {
+            auto node = callback.get();
+            node->pinned = std::move(callback);
+            auto head = callbacks.load(std::memory_order_acquire);
+            do {
+                if (head == settled_mark()) {
+                    callback = std::move(node->pinned);
+                    return false;
+                }
+                node->pushed_next = head;
+            } while (!callbacks.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_acquire));
+            return true;
+        } else {
+            std::lock_guard<mutex_type> lock(mtx);
+            if (state != PromiseState::PENDING) {
+                return false;
+            }
+            push_callback(std::move(callback));
+            return true;
+        }
+    }
+
+    // Runs write, which fills in state and the value or exception, then
+    // marks this state settled and returns the callbacks to trigger. In a
+    // lock-free list that is a single exchange with the settled mark.
+    template<typename Write>
+    inline ContinuationPtr<Executor> settle(Write&& write) {
+        if constexpr (lock_free) {
+            write();
+            auto node = callbacks.exchange(settled_mark(), std::memory_order_acq_rel);
+            ContinuationPtr<Executor> taken;
+            auto link = &taken;
+            while (node) {
+                auto next = node->pushed_next;
+                if (node->claimed.exchange(true, std::memory_order_acq_rel)) {
+                    node->pinned.reset();
+                } else {
+                    *link = std::move(node->pinned);
+                    link = &(*link)->next_callback;
+                }
+                node = next;
+            }
+            return taken;
+        } else {
+            std::lock_guard<mutex_type> lock(mtx);
+            write();
+            return take_callbacks();
+        }
+    }
+
+    // Takes node back out of the list if this state has not settled yet.
+    // A lock-free list only claims the node; it stays linked, and skipped,
+    // until the state settles or is freed.
+    inline bool unlink_pending(Continuation<Executor>& node) {
+        if constexpr (lock_free) {
+            if (callbacks.load(std::memory_order_acquire) == settled_mark()) {
+                return false;
+            }
+            return !node.claimed.exchange(true, std::memory_order_acq_rel);
+        } else {
+            std::lock_guard<mutex_type> lock(mtx);
+            if (state != PromiseState::PENDING || !node.linked) {
+                return false;
+            }
+            unlink_callback(node);
+            return true;
+        }
+    }
+
+    // Never a valid node address.
+    static Continuation<Executor>* settled_mark() {
+        return reinterpret_cast<Continuation<Executor>*>(std::uintptr_t(1));
+    }
+
+    // Callbacks are pushed in front so attaching stays O(1) under the lock;
+    // trigger_callbacks() restores attach order outside of it.
+    inline void push_callback(ContinuationPtr<Executor> callback) {
+        if (callbacks) {
+            callbacks->prev_callback = callback.get();
+        }
+        callback->linked = true;
+        callback->next_callback = std::move(callbacks);
+        callbacks = std::move(callback);
+    }
+
+    // Only valid while pending; the caller keeps its own reference to node.
+    inline void unlink_callback(Continuation<Executor>& node) {
+        auto next = std::move(node.next_callback);
+        if (next) {
+            next->prev_callback = node.prev_callback;
+        }
+        auto prev = node.prev_callback;
+        node.prev_callback = nullptr;
+        node.linked = false;
+        if (prev) {
+            prev->next_callback = std::move(next);
+        } else {
+            callbacks = std::move(next);
+        }
+    }
+
+    inline ContinuationPtr<Executor> take_callbacks() {
+        return std::move(callbacks);
+    }
+
+    static void dispatch(Executor& executor, ContinuationPtr<Executor> callback) {
+        executor([callback = std::move(callback)] () mutable {
+            callback->run(std::move(callback));
+        });
+    }
+
+    static void trigger_callbacks(Executor& executor, ContinuationPtr<Executor> callbacks) {
+        ContinuationPtr<Executor> ordered;
+        while (callbacks) {
+            auto next = std::move(callbacks->next_callback);
+            callbacks->next_callback = std::move(ordered);
+            ordered = std::move(callbacks);
+            callbacks = std::move(next);
+        }
+
+        while (ordered) {
+            auto next = std::move(ordered->next_callback);
+            if (ordered->run_inline) {
+                ordered->run(std::move(ordered));
+            } else {
+                dispatch(executor, std::move(ordered));
+            }
+            ordered = std::move(next);
+        }
+    }
+
+    inline void trigger_callbacks(ContinuationPtr<Executor> callbacks) {
+        trigger_callbacks(executor, std::move(callbacks));
+    }
 };
 
 template<typename T, typename Executor>
 struct SharedState : SharedStateBase<Executor> {
     SharedState(Executor executor) : SharedStateBase<Executor>(std::forward<Executor>(executor)) {}
 
-    std::optional<T> value;
+    alignas(member_alignment<Executor, std::optional<T>>) std::optional<T> value;
+
+    // When the caller holds the last strong reference nobody can read the
+    // value again, so it is moved into fn instead of copied. use_count() is
+    // only a relaxed load: a stale count can only be too high, which falls
+    // back to the copy, and the fence orders this read after the releasing
+    // decrements of the owners that are gone. Weak references (a
+    // Subscription) may still lock the state, but never touch its value.
+    template<typename F>
+    static decltype(auto) consume_value(StatePtr<SharedState, Executor>& state, F& fn) {
+        if (state.use_count() == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return fn(std::move(*state->value));
+        }
+        return fn(*state->value);
+    }
 };
 
 template<typename Executor>
@@ -75,57 +714,241 @@ struct SharedState<void, Executor> : SharedStateBase<Executor> {
     SharedState(Executor executor) : SharedStateBase<Executor>(std::forward<Executor>(executor)) {}
 };
 
+// The state of a promise returned by then(), with the closure that settles it
+// stored inline.
+template<typename T, typename Executor, typename Fn>
+struct ContinuationState : SharedState<T, Executor>, Continuation<Executor> {
+    ContinuationState(Executor executor, Fn fn)
+        : SharedState<T, Executor>(std::forward<Executor>(executor)), fn(std::move(fn)) {}
+
+    std::optional<Fn> fn;
+
+    void run(ContinuationPtr<Executor> self) override {
+        this->trace_started();
+        ContinuationPtr<Executor> callbacks;
+        {
+            cost::Meter meter(this->cost_account());
+            callbacks = std::move(*fn)(static_cast<SharedState<T, Executor>&>(*this));
+            fn.reset();
+        }
+        this->trace_settled();
+        if (!callbacks) {
+            return;
+        }
+
+        // Drop our own reference before dispatching, so this state is freed
+        // as soon as the last downstream continuation has read it.
+        Executor executor = this->executor;
+        self.reset();
+        SharedStateBase<Executor>::trigger_callbacks(executor, std::move(callbacks));
+    }
+
+    // Called once the continuation is out of its parent's list, so fn can
+    // never run; dropping it releases whatever the callbacks captured.
+    void cancel() override {
+        fn.reset();
+
+        auto callbacks = this->settle([this] {
+            this->state = PromiseState::REJECTED;
+            this->exception = std::make_exception_ptr(Cancelled());
+        });
+        this->trace_settled();
+        this->trigger_callbacks(std::move(callbacks));
+    }
+};
+
+// Returned by Promise::subscribe(). Holds no strong references, so an
+// outstanding subscription keeps neither promise alive.
+template<typename Executor>
+class Subscription {
+public:
+    Subscription() = default;
+
+    Subscription(WeakStatePtr<SharedStateBase<Executor>, Executor> parent, WeakStatePtr<Continuation<Executor>, Executor> node)
+        : _parent(std::move(parent)), _node(std::move(node)) {}
+
+    // Unlinks the continuation if its parent has not settled yet. The
+    // promise returned next to this subscription then rejects with
+    // promise::Cancelled. Returns false if the continuation already ran or
+    // was dispatched.
+    bool cancel() {
+        auto parent = _parent.lock();
+        auto node = _node.lock();
+        _parent.reset();
+        _node.reset();
+        if (!parent || !node) {
+            return false;
+        }
+
+        if (!parent->unlink_pending(*node)) {
+            return false;
+        }
+        node->cancel();
+        return true;
+    }
+
+private:
+    WeakStatePtr<SharedStateBase<Executor>, Executor> _parent;
+    WeakStatePtr<Continuation<Executor>, Executor> _node;
+};
+
+template<typename T>
+struct value_signature {
+    using type = execution::set_value_t(T);
+};
+
+template<>
+struct value_signature<void> {
+    using type = execution::set_value_t();
+};
+
+// Operation state of a promise used as a sender. It is linked into the
+// promise's callback list itself, without a shared state of its own; the
+// receiver's owner keeps it alive until it completes.
+template<typename T, typename Executor, typename Receiver>
+class PromiseOperation : Continuation<Executor> {
+public:
+    using operation_state_concept = execution::operation_state_t;
+
+    PromiseOperation(StatePtr<SharedState<T, Executor>, Executor> state, Receiver receiver)
+        : _state(std::move(state)), _receiver(std::move(receiver)) {}
+
+    PromiseOperation(const PromiseOperation&) = delete;
+    PromiseOperation& operator=(const PromiseOperation&) = delete;
+
+    void start() noexcept {
+        ContinuationPtr<Executor> self(ContinuationPtr<Executor>(), static_cast<Continuation<Executor>*>(this));
+
+        if (!_state->link_callback(self)) {
+            SharedStateBase<Executor>::dispatch(_state->executor, std::move(self));
+        }
+    }
+
+private:
+    // Nothing may touch `this` after the receiver is completed.
+    void run(ContinuationPtr<Executor>) override {
+        auto state = std::move(_state);
+        if (state->state == PromiseState::REJECTED) {
+            std::move(_receiver).set_error(state->exception);
+        } else if constexpr (std::is_void_v<T>) {
+            std::move(_receiver).set_value();
+        } else {
+            auto complete = [this](auto&& value) {
+                std::move(_receiver).set_value(std::forward<decltype(value)>(value));
+            };
+            SharedState<T, Executor>::consume_value(state, complete);
+        }
+    }
+
+    void cancel() override {
+        _state.reset();
+        std::move(_receiver).set_stopped();
+    }
+
+    StatePtr<SharedState<T, Executor>, Executor> _state;
+    Receiver _receiver;
+};
+
+template<typename T, typename Executor>
+Promise<T, Executor> adopt_state(StatePtr<SharedState<T, Executor>, Executor> state);
+
+template<typename T, typename Executor>
+const StatePtr<SharedState<T, Executor>, Executor>& state_of(const Promise<T, Executor>& promise);
+
 template<typename T, typename Executor>
 class Promise {
     static_assert(std::is_invocable_v<Executor, std::function<void()>>, "Executor must be invocable with std::function<void()>");
 private:
-    using SharedStatePtr = std::shared_ptr<SharedState<T, Executor>>;
+    using SharedStatePtr = StatePtr<SharedState<T, Executor>, Executor>;
 
     SharedStatePtr _state;
 
     template<typename, typename>
     friend class Promise;
+
+    template<typename U, typename E>
+    friend Promise<U, E> adopt_state(StatePtr<SharedState<U, E>, E> state);
+
+    template<typename U, typename E>
+    friend const StatePtr<SharedState<U, E>, E>& state_of(const Promise<U, E>& promise);
     
     explicit Promise(SharedStatePtr state)
         : _state(std::move(state)) {}
+
+    template<typename NextT, typename Callback>
+    Promise<NextT, Executor> attach(Callback callback, CallSite site, WeakStatePtr<Continuation<Executor>, Executor>* node) {
+        auto next_promise_state = allocate_state<ContinuationState<NextT, Executor, Callback>>(_state->executor, std::move(callback));
+        next_promise_state->attach_site(site);
+        next_promise_state->inherit_trace(*_state);
+        ContinuationPtr<Executor> continuation = next_promise_state;
+        if (node) {
+            *node = continuation;
+        }
+
+        if (!_state->link_callback(continuation)) {
+            SharedStateBase<Executor>::dispatch(_state->executor, std::move(continuation));
+        }
+
+        return Promise<NextT, Executor>(std::move(next_promise_state));
+    }
     
 public:
+    // A promise is also a sender (P2300) that completes on its executor.
+    using sender_concept = execution::sender_t;
+    using completion_signatures = execution::completion_signatures<
+        typename value_signature<T>::type,
+        execution::set_error_t(std::exception_ptr),
+        execution::set_stopped_t()
+    >;
+
     template<typename Task>
     explicit Promise(
         Task task,
-        Executor executor
-    ) : _state(std::make_shared<SharedState<T, Executor>>(std::forward<Executor>(executor))) {
+        Executor executor,
+        CallSite site = CallSite::current()
+    ) : _state(allocate_state<SharedState<T, Executor>>(executor)) {
+        _state->attach_site(site);
+        _state->start_trace();
+
+        if (auto budget = executor_budget<Executor>::get(_state->executor); budget && !admit(*budget, _state->executor)) {
+            _state->settle([this] {
+                _state->state = PromiseState::REJECTED;
+                _state->exception = std::make_exception_ptr(BudgetExceeded());
+            });
+            _state->trace_settled();
+            return;
+        }
 
         auto reject = [state = this->_state](std::exception_ptr e) {
-            std::vector<std::function<void()>> callbacks;
-            {
-                std::lock_guard<std::mutex> lock(state->mtx);
+            auto callbacks = state->settle([&] {
                 assert(state->state == PromiseState::PENDING);
                 state->state = PromiseState::REJECTED;
                 state->exception = e;
-                state->callbacks.swap(callbacks);
-            }
-            state->trigger_callbacks(callbacks);
+            });
+            state->trace_settled();
+            state->trigger_callbacks(std::move(callbacks));
         };
 
         using reject_t = decltype(reject);
 
         if constexpr (std::is_void_v<T>) {
             auto resolve = [state = this->_state]() {
-                std::vector<std::function<void()>> callbacks;
-                {
-                    std::lock_guard<std::mutex> lock(state->mtx);
+                auto callbacks = state->settle([&] {
                     assert(state->state == PromiseState::PENDING);
                     state->state = PromiseState::FULFILLED;
-                    state->callbacks.swap(callbacks);
-                }
-                state->trigger_callbacks(callbacks);
+                });
+                state->trace_settled();
+                state->trigger_callbacks(std::move(callbacks));
             };
 
             using resolve_t = decltype(resolve);
             static_assert(std::is_invocable_r_v<void, Task, resolve_t, reject_t>, "Task must be invocable with resolve(value) and reject(exception_ptr), and return void");
 
-            auto callback = [t = std::move(task), res = std::move(resolve), rej = std::move(reject)]() {
+            auto callback = [t = std::move(task), res = std::move(resolve), rej = std::move(reject), diagnostics = _state->diagnostics.get()]() {
+                if (diagnostics && diagnostics->trace) {
+                    diagnostics->trace->started(diagnostics->trace_hop);
+                }
+                cost::Meter meter(diagnostics && diagnostics->account ? &diagnostics->account : nullptr);
                 try {
                     t(res, rej);
                 } catch (...) {
@@ -137,22 +960,24 @@ public:
             static_assert(std::is_invocable_v<Executor, decltype(callback)>, "Executor must be invocable with callback()");
         } else {
             auto resolve = [state = this->_state](T value) {
-                std::vector<std::function<void()>> callbacks;
-                {
-                    std::lock_guard<std::mutex> lock(state->mtx);
+                auto callbacks = state->settle([&] {
                     assert(state->state == PromiseState::PENDING);
                     state->state = PromiseState::FULFILLED;
                     state->value = std::move(value);
-                    state->callbacks.swap(callbacks);
-                }
-                state->trigger_callbacks(callbacks);
+                });
+                state->trace_settled();
+                state->trigger_callbacks(std::move(callbacks));
             };
 
             
             using resolve_t = decltype(resolve);
             static_assert(std::is_invocable_r_v<void, Task, resolve_t, reject_t>, "Task must be invocable with resolve(value) and reject(exception_ptr), and return void");
 
-            auto callback = [t = std::move(task), res = std::move(resolve), rej = std::move(reject)]() {
+            auto callback = [t = std::move(task), res = std::move(resolve), rej = std::move(reject), diagnostics = _state->diagnostics.get()]() {
+                if (diagnostics && diagnostics->trace) {
+                    diagnostics->trace->started(diagnostics->trace_hop);
+                }
+                cost::Meter meter(diagnostics && diagnostics->account ? &diagnostics->account : nullptr);
                 try {
                     t(res, rej);
                 } catch (...) {
@@ -165,162 +990,196 @@ public:
         }
     }
 
+private:
     template<
         typename FulfilledFn,
         typename RejectedFn
     >
-    auto then (
+    auto chain(
         FulfilledFn onFulfilled,
-        RejectedFn onRejected
+        RejectedFn onRejected,
+        CallSite site,
+        WeakStatePtr<Continuation<Executor>, Executor>* node
     ) {
         static_assert(std::is_invocable_v<RejectedFn, std::exception_ptr>, "RejectedFn must be invocable with std::exception_ptr");
         if constexpr (std::is_void_v<T>) {
             using NextT = std::invoke_result_t<FulfilledFn>;
             static_assert(std::is_invocable_v<FulfilledFn>, "FulfilledFn must be invocable");
-            
-            auto next_promise_state = std::make_shared<SharedState<NextT, Executor>>(_state->executor);
-            auto next_promise = Promise<NextT, Executor>(next_promise_state);
 
-            auto callback = [state = this->_state, next_promise_state, onFulfilled = std::move(onFulfilled), onRejected = std::move(onRejected)] {
-                std::vector<std::function<void()>> callbacks;
+            auto callback = [state = this->_state, onFulfilled = std::move(onFulfilled), onRejected = std::move(onRejected)] (SharedState<NextT, Executor>& next) mutable {
+                auto parent = std::move(state);
+                ContinuationPtr<Executor> callbacks;
                 try {
-                    if (state->state == PromiseState::FULFILLED) {
+                    if (parent->state == PromiseState::FULFILLED) {
                         if constexpr (std::is_void_v<NextT>) {
                             onFulfilled();
 
-                            std::lock_guard<std::mutex> next_lock(next_promise_state->mtx);
-                            next_promise_state->state = PromiseState::FULFILLED;
-                            next_promise_state->callbacks.swap(callbacks);
+                            callbacks = next.settle([&] {
+                                next.state = PromiseState::FULFILLED;
+                            });
                         } else {
                             NextT value = onFulfilled();
 
-                            std::lock_guard<std::mutex> next_lock(next_promise_state->mtx);
-                            next_promise_state->state = PromiseState::FULFILLED;
-                            next_promise_state->value = std::move(value);
-                            next_promise_state->callbacks.swap(callbacks);
+                            callbacks = next.settle([&] {
+                                next.state = PromiseState::FULFILLED;
+                                next.value = std::move(value);
+                            });
                         }
                     } else {
                         using RejType = std::invoke_result_t<RejectedFn, std::exception_ptr>;
                         if constexpr (std::is_void_v<RejType>) {
-                            onRejected(*state->exception);
+                            onRejected(parent->exception);
 
                             // If RejectedFn returns void and next value expect not void
                             if constexpr (!std::is_void_v<NextT>) {
                                 //Oops!, this will never happen
                                 throw std::runtime_error("Oops!, RejectedFn returns void and next value expect not void");
+                            } else {
+                                callbacks = next.settle([&] {
+                                    next.state = PromiseState::FULFILLED;
+                                });
                             }
                         } else {
                             static_assert(std::is_same_v<NextT, RejType>, "FulfilledFn and RejectedFn must be the same type");
-                            NextT value = onRejected(*state->exception);
+                            NextT value = onRejected(parent->exception);
 
-                            std::lock_guard<std::mutex> next_lock(next_promise_state->mtx);
-                            next_promise_state->state = PromiseState::FULFILLED;
-                            next_promise_state->value = std::move(value);
-                            next_promise_state->callbacks.swap(callbacks);
+                            callbacks = next.settle([&] {
+                                next.state = PromiseState::FULFILLED;
+                                next.value = std::move(value);
+                            });
                         }
                     }
                 } catch (...) {
-                    std::lock_guard<std::mutex> next_lock(next_promise_state->mtx);
-                    next_promise_state->state = PromiseState::REJECTED;
-                    next_promise_state->exception = std::current_exception();
-                    next_promise_state->callbacks.swap(callbacks);
+                    callbacks = next.settle([&] {
+                        next.state = PromiseState::REJECTED;
+                        next.exception = std::current_exception();
+                    });
                 }
-                
-                next_promise_state->trigger_callbacks(callbacks);
-            };
-
-            static_assert(std::is_invocable_v<Executor, decltype(callback)>, "Executor must be invocable with callback");
 
-            std::lock_guard<std::mutex> lock(_state->mtx);
-            if (_state->state != PromiseState::PENDING) {
-                _state->executor(std::move(callback));
-            } else {
-                _state->callbacks.push_back(std::move(callback));
-            }
+                return callbacks;
+            };
 
-            return next_promise;
+            return attach<NextT>(std::move(callback), site, node);
         } else {
             using NextT = std::invoke_result_t<FulfilledFn, T>;
             static_assert(std::is_invocable_v<FulfilledFn, T>, "FulfilledFn must be invocable with T");
 
-            auto next_promise_state = std::make_shared<SharedState<NextT, Executor>>(_state->executor);
-            auto next_promise = Promise<NextT, Executor>(next_promise_state);
-
-            auto callback = [state = this->_state, next_promise_state, onFulfilled = std::move(onFulfilled), onRejected = std::move(onRejected)] {
-                std::vector<std::function<void()>> callbacks;
+            auto callback = [state = this->_state, onFulfilled = std::move(onFulfilled), onRejected = std::move(onRejected)] (SharedState<NextT, Executor>& next) mutable {
+                auto parent = std::move(state);
+                ContinuationPtr<Executor> callbacks;
                 try {
-                    if (state->state == PromiseState::FULFILLED) {
+                    if (parent->state == PromiseState::FULFILLED) {
                         if constexpr (std::is_void_v<NextT>) {
-                            onFulfilled(*state->value);
+                            SharedState<T, Executor>::consume_value(parent, onFulfilled);
 
-                            std::lock_guard<std::mutex> next_lock(next_promise_state->mtx);
-                            next_promise_state->state = PromiseState::FULFILLED;
-                            next_promise_state->callbacks.swap(callbacks);
+                            callbacks = next.settle([&] {
+                                next.state = PromiseState::FULFILLED;
+                            });
                         } else {
-                            NextT value = onFulfilled(*state->value);
+                            NextT value = SharedState<T, Executor>::consume_value(parent, onFulfilled);
 
-                            std::lock_guard<std::mutex> next_lock(next_promise_state->mtx);
-                            next_promise_state->state = PromiseState::FULFILLED;
-                            next_promise_state->value = std::move(value);
-                            next_promise_state->callbacks.swap(callbacks);
+                            callbacks = next.settle([&] {
+                                next.state = PromiseState::FULFILLED;
+                                next.value = std::move(value);
+                            });
                         }
                     } else {
                         using RejType = std::invoke_result_t<RejectedFn, std::exception_ptr>;
                         if constexpr (std::is_void_v<RejType>) {
-                            onRejected(*state->exception);
+                            onRejected(parent->exception);
 
                             // If RejectedFn returns void and next value expect not void
                             if constexpr (!std::is_void_v<NextT>) {
                                 //Oops!, this will never happen
                                 throw std::runtime_error("Oops!, RejectedFn returns void and next value expect not void");
+                            } else {
+                                callbacks = next.settle([&] {
+                                    next.state = PromiseState::FULFILLED;
+                                });
                             }
                         } else {
                             static_assert(std::is_same_v<NextT, RejType>, "FulfilledFn and RejectedFn must be the same type");
-                            NextT value = onRejected(*state->exception);
+                            NextT value = onRejected(parent->exception);
 
-                            std::lock_guard<std::mutex> next_lock(next_promise_state->mtx);
-                            next_promise_state->state = PromiseState::FULFILLED;
-                            next_promise_state->value = std::move(value);
-                            next_promise_state->callbacks.swap(callbacks);
+                            callbacks = next.settle([&] {
+                                next.state = PromiseState::FULFILLED;
+                                next.value = std::move(value);
+                            });
                         }
                     }
                 } catch (...) {
-                    std::lock_guard<std::mutex> next_lock(next_promise_state->mtx);
-                    next_promise_state->state = PromiseState::REJECTED;
-                    next_promise_state->exception = std::current_exception();
-                    next_promise_state->callbacks.swap(callbacks);
+                    callbacks = next.settle([&] {
+                        next.state = PromiseState::REJECTED;
+                        next.exception = std::current_exception();
+                    });
                 }
-                
-                next_promise_state->trigger_callbacks(callbacks);
-            };
 
-            static_assert(std::is_invocable_v<Executor, decltype(callback)>, "Executor must be invocable with callback");
-
-            std::lock_guard<std::mutex> lock(_state->mtx);
-            if (_state->state != PromiseState::PENDING) {
-                _state->executor(std::move(callback));
-            } else {
-                _state->callbacks.emplace_back(std::move(callback));
-            }
+                return callbacks;
+            };
 
-            return next_promise;
+            return attach<NextT>(std::move(callback), site, node);
         }
     }
 
+public:
+    template<
+        typename FulfilledFn,
+        typename RejectedFn
+    >
+    inline auto then (
+        FulfilledFn onFulfilled,
+        RejectedFn onRejected,
+        CallSite site = CallSite::current()
+    ) {
+        return chain(std::move(onFulfilled), std::move(onRejected), site, nullptr);
+    }
+
     template<typename FulfilledFn>
-    inline auto then (FulfilledFn onFulfilled) {
+    inline auto then (FulfilledFn onFulfilled, CallSite site = CallSite::current()) {
         return then(std::forward<FulfilledFn>(onFulfilled), [] (auto e) {
             std::rethrow_exception(e);
-        });
+        }, site);
+    }
+
+    // Like then(), but also returns a Subscription that detaches the
+    // callbacks again while this promise is still pending.
+    template<
+        typename FulfilledFn,
+        typename RejectedFn
+    >
+    inline auto subscribe(
+        FulfilledFn onFulfilled,
+        RejectedFn onRejected,
+        CallSite site = CallSite::current()
+    ) {
+        WeakStatePtr<Continuation<Executor>, Executor> node;
+        auto next = chain(std::move(onFulfilled), std::move(onRejected), site, &node);
+        return std::make_pair(std::move(next), Subscription<Executor>(_state, std::move(node)));
+    }
+
+    template<typename FulfilledFn>
+    inline auto subscribe(FulfilledFn onFulfilled, CallSite site = CallSite::current()) {
+        return subscribe(std::forward<FulfilledFn>(onFulfilled), [] (auto e) {
+            std::rethrow_exception(e);
+        }, site);
+    }
+
+    template<typename Receiver>
+    PromiseOperation<T, Executor, Receiver> connect(Receiver receiver) const {
+        return PromiseOperation<T, Executor, Receiver>(_state, std::move(receiver));
+    }
+
+    execution::empty_env get_env() const noexcept {
+        return {};
     }
 
     template<typename RejectedFn>
-    inline auto catch_err(RejectedFn onRejected) {
-        return then([] (const T& v) { return v; }, std::forward<RejectedFn>(onRejected));
+    inline auto catch_err(RejectedFn onRejected, CallSite site = CallSite::current()) {
+        return then([] (const T& v) { return v; }, std::forward<RejectedFn>(onRejected), site);
     }
 
     template<typename F>
-    inline auto finally(F onFinally) {
+    inline auto finally(F onFinally, CallSite site = CallSite::current()) {
         return then(
             [onFinally](const T& v) {
                 onFinally();
@@ -329,57 +1188,86 @@ public:
             [onFinally](std::exception_ptr e) {
                 onFinally();
                 std::rethrow_exception(e);
-            }
+            },
+            site
         );
     }
 
     template<typename U = T>
-    static auto resolve(U v, Executor executor)
+    static auto resolve(U v, Executor executor, CallSite site = CallSite::current())
         -> std::enable_if_t<!std::is_void_v<U>, Promise<U, Executor>> {
-        auto state = std::make_shared<SharedState<U, Executor>>(std::forward<Executor>(executor));
+        auto state = allocate_state<SharedState<U, Executor>>(executor);
+        state->attach_site(site);
         auto promise = Promise<U, Executor>(state);
 
         state->executor = std::move(executor);
-        state->state = PromiseState::FULFILLED;
-        state->value = std::move(v);
+        state->settle([&] {
+            state->state = PromiseState::FULFILLED;
+            state->value = std::move(v);
+        });
+        state->start_trace();
+        state->trace_settled();
 
         return promise;
     }
 
     template<typename U = T>
-    static auto resolve(Executor executor)
+    static auto resolve(Executor executor, CallSite site = CallSite::current())
         -> std::enable_if_t<std::is_void_v<U>, Promise<U, Executor>> {
-        auto state = std::make_shared<SharedState<U, Executor>>(std::forward<Executor>(executor));
+        auto state = allocate_state<SharedState<U, Executor>>(executor);
+        state->attach_site(site);
         auto promise = Promise<U, Executor>(state);
 
         state->executor = std::move(executor);
-        state->state = PromiseState::FULFILLED;
+        state->settle([&] {
+            state->state = PromiseState::FULFILLED;
+        });
+        state->start_trace();
+        state->trace_settled();
 
         return promise;
     }
 
-    static auto reject(std::exception e, Executor executor) {
-        auto state = std::make_shared<SharedState<T, Executor>>(std::forward<Executor>(executor));
+    static auto reject(std::exception e, Executor executor, CallSite site = CallSite::current()) {
+        auto state = allocate_state<SharedState<T, Executor>>(executor);
+        state->attach_site(site);
         auto promise = Promise<T, Executor>(state);
 
         state->executor = std::move(executor);
-        state->state = PromiseState::REJECTED;
-        state->exception = std::make_exception_ptr(std::move(e));
+        state->settle([&] {
+            state->state = PromiseState::REJECTED;
+            state->exception = std::make_exception_ptr(std::move(e));
+        });
+        state->start_trace();
+        state->trace_settled();
 
         return promise;
     }
 };
 
+template<typename T, typename Executor>
+Promise<T, Executor> adopt_state(StatePtr<SharedState<T, Executor>, Executor> state) {
+    return Promise<T, Executor>(std::move(state));
+}
+
+template<typename T, typename Executor>
+const StatePtr<SharedState<T, Executor>, Executor>& state_of(const Promise<T, Executor>& promise) {
+    return promise._state;
+}
+
 }
 
 template<typename T, typename Executor>
 using Promise = internal::Promise<T, Executor>;
 
+template<typename Executor>
+using Subscription = internal::Subscription<Executor>;
+
 template<typename T, typename Executor>
 struct UsePromise {
     template<typename Task>
-    inline auto operator()(Task task, Executor executor = Executor()) {
-        return Promise<T, Executor>(std::forward<Task>(task), std::forward<Executor>(executor));
+    inline auto operator()(Task task, Executor executor = Executor(), CallSite site = CallSite::current()) {
+        return Promise<T, Executor>(std::forward<Task>(task), std::forward<Executor>(executor), site);
     }
 };
 
@@ -387,48 +1275,49 @@ struct UsePromise {
 template<typename T>
 struct UsePromise<T, void> {
     template<typename Task, typename Executor>
-    inline auto operator()(Task task, Executor executor) {
-        return Promise<T, Executor>(std::forward<Task>(task), std::forward<Executor>(executor));
+    inline auto operator()(Task task, Executor executor, CallSite site = CallSite::current()) {
+        return Promise<T, Executor>(std::forward<Task>(task), std::forward<Executor>(executor), site);
     }
 };
 
 template<typename T, typename Executor>
 struct UseResolve {
     template<typename U = T>
-    inline auto operator()(T v, Executor executor = Executor())
+    inline auto operator()(T v, Executor executor = Executor(), CallSite site = CallSite::current())
         -> std::enable_if_t<!std::is_void_v<U>, Promise<T, Executor>> {
-        return Promise<T, Executor>::resolve(std::forward<T>(v), std::forward<Executor>(executor));
+        return Promise<T, Executor>::resolve(std::forward<T>(v), std::forward<Executor>(executor), site);
     }
 
     template<typename U = T>
-    inline auto operator()(Executor executor = Executor())
+    inline auto operator()(Executor executor = Executor(), CallSite site = CallSite::current())
         -> std::enable_if_t<std::is_void_v<U>, Promise<T, Executor>> {
-        return Promise<T, Executor>::resolve(std::forward<Executor>(executor));
+        return Promise<T, Executor>::resolve(std::forward<Executor>(executor), site);
     }
 };
 
 template<typename T>
 struct UseResolve<T, void> {
     template<typename Executor, typename U = T>
-    inline auto operator()(T v, Executor executor)
+    inline auto operator()(T v, Executor executor, CallSite site = CallSite::current())
         -> std::enable_if_t<!std::is_void_v<U>, Promise<T, Executor>> {
-        return Promise<T, Executor>::resolve(std::forward<T>(v), std::forward<Executor>(executor));
+        return Promise<T, Executor>::resolve(std::forward<T>(v), std::forward<Executor>(executor), site);
     }
 
     template<typename U = T, typename Executor>
-    inline auto operator()(Executor executor)
+    inline auto operator()(Executor executor, CallSite site = CallSite::current())
         -> std::enable_if_t<std::is_void_v<U>, Promise<T, Executor>> {
-        return Promise<T, Executor>::resolve(std::forward<Executor>(executor));
+        return Promise<T, Executor>::resolve(std::forward<Executor>(executor), site);
     }
 };
 
 template<typename T, typename Executor>
 struct UseReject {
     template<typename E>
-    inline auto operator()(E e, Executor executor = Executor()) {
+    inline auto operator()(E e, Executor executor = Executor(), CallSite site = CallSite::current()) {
         return Promise<T, Executor>::reject(
             std::forward<E>(e),
-            std::forward<Executor>(executor)
+            std::forward<Executor>(executor),
+            site
         );
     }
 };
@@ -436,10 +1325,11 @@ struct UseReject {
 template<typename T>
 struct UseReject<T, void> {
     template<typename E, typename Executor>
-    inline auto operator()(E e, Executor executor) {
+    inline auto operator()(E e, Executor executor, CallSite site = CallSite::current()) {
         return Promise<T, Executor>::reject(
             std::forward<E>(e),
-            std::forward<Executor>(executor)
+            std::forward<Executor>(executor),
+            site
         );
     }
 };
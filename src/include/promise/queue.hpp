@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "promise.hpp"
+
+namespace promise {
+
+// Priority queue whose pop() returns a promise. Items live in several
+// independently locked heaps (a MultiQueue): push picks one at random, pop
+// takes the better top of two random heaps. With more than one shard the
+// order is relaxed - a pop may return an item slightly behind the true
+// maximum - in exchange for pushes and pops on different heaps never
+// contending. One shard gives strict priority order.
+//
+// A signed count of items minus waiting poppers decides, without a lock,
+// whether a push must complete a waiting pop() directly instead of going
+// into a heap. pop() calls still waiting when the queue is destroyed reject
+// with promise::Cancelled.
+template<typename T, typename Compare = std::less<T>>
+class AsyncPriorityQueue {
+public:
+    explicit AsyncPriorityQueue(
+        std::size_t shards = std::max(1u, std::thread::hardware_concurrency()),
+        Compare compare = Compare()
+    ) : _shards(std::max<std::size_t>(shards, 1)), _compare(std::move(compare)) {}
+
+    AsyncPriorityQueue(const AsyncPriorityQueue&) = delete;
+    AsyncPriorityQueue& operator=(const AsyncPriorityQueue&) = delete;
+
+    ~AsyncPriorityQueue() {
+        auto error = std::make_exception_ptr(Cancelled());
+        for (auto& waiter : _waiters) {
+            waiter->fail(error);
+        }
+    }
+
+    void push(T value) {
+        if (_count.fetch_add(1, std::memory_order_acq_rel) < 0) {
+            hand_to_waiter(std::move(value));
+            return;
+        }
+
+        auto& shard = _shards[random() % _shards.size()];
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        shard.heap.push_back(std::move(value));
+        std::push_heap(shard.heap.begin(), shard.heap.end(), _compare);
+    }
+
+    // Settles with the next item, right away if one is queued, otherwise as
+    // soon as a push() arrives. The count and the waiter list are updated
+    // here rather than in a task on the executor, so a push that sees this
+    // pop waiting finds it registered within a few instructions.
+    template<typename Executor>
+    Promise<T, Executor> pop(Executor executor) {
+        if (_count.fetch_sub(1, std::memory_order_acq_rel) > 0) {
+            return Promise<T, Executor>::resolve(take(), std::move(executor));
+        }
+
+        auto waiter = std::make_shared<Waiter>();
+        {
+            std::lock_guard<std::mutex> lock(_waiters_mtx);
+            _waiters.push_back(waiter);
+        }
+        return usePromise<T>([waiter](auto resolve, auto reject) {
+            waiter->attach(resolve, reject);
+        }, std::move(executor));
+    }
+
+    std::optional<T> try_pop() {
+        auto count = _count.load(std::memory_order_acquire);
+        while (count > 0) {
+            if (_count.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel)) {
+                return take();
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Items queued, or minus the number of waiting pop() calls.
+    std::ptrdiff_t size() const {
+        return _count.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::mutex mtx;
+        std::vector<T> heap;
+    };
+
+    // A pop() waiting for a push. The item (or cancellation) and the
+    // promise's resolver may arrive in either order; the second settles it.
+    struct Waiter {
+        std::mutex mtx;
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::function<void(T)> resolve;
+        std::function<void(std::exception_ptr)> reject;
+
+        void attach(std::function<void(T)> on_value, std::function<void(std::exception_ptr)> on_error) {
+            std::unique_lock<std::mutex> lock(mtx);
+            if (!value && !error) {
+                resolve = std::move(on_value);
+                reject = std::move(on_error);
+                return;
+            }
+            lock.unlock();
+            if (value) {
+                on_value(std::move(*value));
+            } else {
+                on_error(error);
+            }
+        }
+
+        void deliver(T item) {
+            std::unique_lock<std::mutex> lock(mtx);
+            if (!resolve) {
+                value.emplace(std::move(item));
+                return;
+            }
+            auto on_value = std::move(resolve);
+            lock.unlock();
+            on_value(std::move(item));
+        }
+
+        void fail(std::exception_ptr e) {
+            std::unique_lock<std::mutex> lock(mtx);
+            if (!reject) {
+                error = e;
+                return;
+            }
+            auto on_error = std::move(reject);
+            lock.unlock();
+            on_error(e);
+        }
+    };
+
+    static std::uint32_t random() {
+        thread_local std::uint32_t state = static_cast<std::uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // The count promised us an item; its push may be between its count
+    // update and its heap insert, so keep looking until it lands.
+    T take() {
+        while (true) {
+            auto a = random() % _shards.size();
+            auto b = random() % _shards.size();
+            if (a > b) {
+                std::swap(a, b);
+            }
+
+            if (auto value = pop_better(a, b)) {
+                return std::move(*value);
+            }
+            for (std::size_t i = 0; i < _shards.size(); ++i) {
+                if (auto value = pop_better(i, i)) {
+                    return std::move(*value);
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    std::optional<T> pop_better(std::size_t a, std::size_t b) {
+        std::unique_lock<std::mutex> first(_shards[a].mtx);
+        std::unique_lock<std::mutex> second;
+        if (b != a) {
+            second = std::unique_lock<std::mutex>(_shards[b].mtx);
+        }
+
+        auto* best = &_shards[a].heap;
+        auto& other = _shards[b].heap;
+        if (best->empty() || (!other.empty() && _compare(best->front(), other.front()))) {
+            best = &other;
+        }
+        if (best->empty()) {
+            return std::nullopt;
+        }
+
+        std::pop_heap(best->begin(), best->end(), _compare);
+        std::optional<T> value(std::move(best->back()));
+        best->pop_back();
+        return value;
+    }
+
+    // The count says a pop() is waiting; it may be between its count update
+    // and its registration, both made in pop() itself.
+    void hand_to_waiter(T value) {
+        std::shared_ptr<Waiter> waiter;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(_waiters_mtx);
+                if (!_waiters.empty()) {
+                    waiter = std::move(_waiters.front());
+                    _waiters.pop_front();
+                    break;
+                }
+            }
+            std::this_thread::yield();
+        }
+        waiter->deliver(std::move(value));
+    }
+
+    std::vector<Shard> _shards;
+    Compare _compare;
+
+    alignas(64) std::atomic<std::ptrdiff_t> _count{0};
+
+    std::mutex _waiters_mtx;
+    std::deque<std::shared_ptr<Waiter>> _waiters;
+};
+
+}
@@ -0,0 +1,458 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+#include "promise.hpp"
+
+namespace promise {
+
+// Bounded single-producer single-consumer queue used to pass work between
+// two cores without locks.
+template<typename T>
+class SpscRing {
+public:
+    explicit SpscRing(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        _slots.resize(size);
+        _mask = size - 1;
+    }
+
+    bool push(T& value) {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head_cache > _mask) {
+            _head_cache = _head.load(std::memory_order_acquire);
+            if (tail - _head_cache > _mask) {
+                return false;
+            }
+        }
+
+        _slots[tail & _mask] = std::move(value);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        auto head = _head.load(std::memory_order_relaxed);
+        if (head == _tail_cache) {
+            _tail_cache = _tail.load(std::memory_order_acquire);
+            if (head == _tail_cache) {
+                return false;
+            }
+        }
+
+        value = std::move(_slots[head & _mask]);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> _slots;
+    std::size_t _mask = 0;
+
+    alignas(64) std::atomic<std::size_t> _head{0};
+    std::size_t _tail_cache = 0;
+
+    alignas(64) std::atomic<std::size_t> _tail{0};
+    std::size_t _head_cache = 0;
+};
+
+// Shared-nothing runtime: one event loop thread per core, with an SPSC ring
+// for every ordered pair of cores. Promises created with CoreExecutor stay
+// on the core that created them and skip the shared-state lock.
+class CoreRuntime {
+public:
+    using Task = std::function<void()>;
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    explicit CoreRuntime(
+        std::size_t cores = std::max(1u, std::thread::hardware_concurrency()),
+        bool pin = false,
+        std::size_t ring_capacity = 1024
+    ) {
+        for (std::size_t i = 0; i < cores; ++i) {
+            _cores.push_back(std::make_unique<Core>());
+        }
+        for (auto& core : _cores) {
+            for (std::size_t i = 0; i < cores; ++i) {
+                core->inbox.push_back(std::make_unique<SpscRing<Task>>(ring_capacity));
+            }
+            core->overflow.resize(cores);
+        }
+        for (std::size_t i = 0; i < cores; ++i) {
+            _cores[i]->thread = std::thread([this, i] { loop(i); });
+            if (pin) {
+                pin_to_cpu(_cores[i]->thread, i);
+            }
+        }
+    }
+
+    CoreRuntime(const CoreRuntime&) = delete;
+    CoreRuntime& operator=(const CoreRuntime&) = delete;
+
+    ~CoreRuntime() {
+        stop();
+    }
+
+    std::size_t size() const {
+        return _cores.size();
+    }
+
+    // Runs task on `core`. From a core thread this goes through the SPSC
+    // ring of that pair of cores; from any other thread it takes a lock.
+    void post(std::size_t core, Task task) {
+        assert(core < _cores.size());
+        auto& target = *_cores[core];
+
+        if (current() == this) {
+            auto from = current_core();
+            if (from == core) {
+                target.local.push_back(std::move(task));
+                return;
+            }
+
+            auto& self = *_cores[from];
+            if (!self.overflow[core].empty() || !target.inbox[from]->push(task)) {
+                self.overflow[core].push_back(std::move(task));
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(target.external_mtx);
+            target.external.push_back(std::move(task));
+        }
+
+        wake(target);
+    }
+
+    void stop() {
+        if (_stopping.exchange(true)) {
+            return;
+        }
+
+        for (auto& core : _cores) {
+            {
+                std::lock_guard<std::mutex> lock(core->park_mtx);
+            }
+            core->park_cv.notify_one();
+        }
+        for (auto& core : _cores) {
+            if (core->thread.joinable()) {
+                core->thread.join();
+            }
+        }
+    }
+
+    static CoreRuntime* current() {
+        return tls().runtime;
+    }
+
+    // Runs one round of the calling core's queued work; a core blocked on
+    // one of its own promises must keep running the core, since nothing
+    // else will. Returns false when nothing ran or the caller is not a core
+    // of this runtime.
+    bool help() {
+        if (current() != this) {
+            return false;
+        }
+        return run_once(tls().core);
+    }
+
+    static std::size_t current_core() {
+        return tls().runtime ? tls().core : npos;
+    }
+
+private:
+    struct Core {
+        std::deque<Task> local;
+        std::vector<std::unique_ptr<SpscRing<Task>>> inbox;
+        std::vector<std::deque<Task>> overflow;
+
+        std::mutex external_mtx;
+        std::vector<Task> external;
+
+        std::atomic<bool> sleeping{false};
+        std::mutex park_mtx;
+        std::condition_variable park_cv;
+
+        std::thread thread;
+    };
+
+    struct Tls {
+        CoreRuntime* runtime = nullptr;
+        std::size_t core = 0;
+    };
+
+    static Tls& tls() {
+        thread_local Tls tls;
+        return tls;
+    }
+
+    static void pin_to_cpu(std::thread& thread, std::size_t cpu) {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu % CPU_SETSIZE, &set);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+        (void)thread;
+        (void)cpu;
+#endif
+    }
+
+    void wake(Core& core) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (core.sleeping.load(std::memory_order_relaxed)) {
+            {
+                std::lock_guard<std::mutex> lock(core.park_mtx);
+            }
+            core.park_cv.notify_one();
+        }
+    }
+
+    bool has_work(Core& core) {
+        if (!core.local.empty()) {
+            return true;
+        }
+        for (auto& ring : core.inbox) {
+            if (!ring->empty()) {
+                return true;
+            }
+        }
+        for (auto& pending : core.overflow) {
+            if (!pending.empty()) {
+                return true;
+            }
+        }
+        std::lock_guard<std::mutex> lock(core.external_mtx);
+        return !core.external.empty();
+    }
+
+    void loop(std::size_t index) {
+        tls() = Tls{this, index};
+        auto& core = *_cores[index];
+
+        while (!_stopping.load(std::memory_order_relaxed)) {
+            run_once(index);
+            if (has_work(core)) {
+                continue;
+            }
+
+            // Pairs with the fence in wake(): either the poster sees us
+            // sleeping and notifies, or we see its work here.
+            core.sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            {
+                std::unique_lock<std::mutex> lock(core.park_mtx);
+                core.park_cv.wait(lock, [&] {
+                    return _stopping.load(std::memory_order_relaxed) || has_work(core);
+                });
+            }
+            core.sleeping.store(false, std::memory_order_relaxed);
+        }
+
+        tls() = Tls{};
+    }
+
+    // Re-entrant: a task may call it again through help().
+    bool run_once(std::size_t index) {
+        auto& core = *_cores[index];
+
+        constexpr std::size_t batch = 256;
+        bool ran = false;
+        Task task;
+        std::vector<Task> external;
+
+        for (std::size_t to = 0; to < core.overflow.size(); ++to) {
+            auto& pending = core.overflow[to];
+            while (!pending.empty() && _cores[to]->inbox[index]->push(pending.front())) {
+                pending.pop_front();
+                wake(*_cores[to]);
+            }
+        }
+
+        for (auto& ring : core.inbox) {
+            for (std::size_t i = 0; i < batch && ring->pop(task); ++i) {
+                task();
+                ran = true;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(core.external_mtx);
+            external.swap(core.external);
+        }
+        for (auto& t : external) {
+            t();
+            ran = true;
+        }
+
+        for (std::size_t i = 0; i < batch && !core.local.empty(); ++i) {
+            task = std::move(core.local.front());
+            core.local.pop_front();
+            task();
+            ran = true;
+        }
+        return ran;
+    }
+
+    std::vector<std::unique_ptr<Core>> _cores;
+    std::atomic<bool> _stopping{false};
+};
+
+// Runs continuations on the core that is running the caller. Promises using
+// it must only be touched from that core.
+struct CoreExecutor {
+    using core_local = std::true_type;
+
+    template<typename F>
+    inline void operator()(F f) const {
+        auto runtime = CoreRuntime::current();
+        assert(runtime && "CoreExecutor used outside a CoreRuntime thread");
+        runtime->post(CoreRuntime::current_core(), std::move(f));
+    }
+
+    bool help() const {
+        auto runtime = CoreRuntime::current();
+        return runtime && runtime->help();
+    }
+
+    bool owns_current_thread() const {
+        return CoreRuntime::current() != nullptr;
+    }
+};
+
+namespace internal {
+
+// The promise end of a submit_to() round trip. Its state is core-local and
+// its reference count is not atomic, so the other core only carries it there
+// and back, by move, and it settles on the home core. Dropped unrun because
+// the runtime stopped (every core is joined by then), it marks the promise
+// cancelled and lets go of the continuations linked to it, which would
+// otherwise keep the state alive forever.
+template<typename R>
+class RoundTrip {
+public:
+    using State = SharedState<R, CoreExecutor>;
+
+    explicit RoundTrip(StatePtr<State, CoreExecutor> state) : _state(std::move(state)) {}
+
+    RoundTrip(const RoundTrip&) = delete;
+    RoundTrip& operator=(const RoundTrip&) = delete;
+
+    ~RoundTrip() {
+        if (_state) {
+            _state->settle([this] {
+                _state->state = PromiseState::REJECTED;
+                _state->exception = std::make_exception_ptr(Cancelled());
+            });
+        }
+    }
+
+    template<typename... V>
+    void fulfill(V&&... value) {
+        auto state = std::move(_state);
+        auto callbacks = state->settle([&] {
+            state->state = PromiseState::FULFILLED;
+            if constexpr (!std::is_void_v<R>) {
+                state->value.emplace(std::forward<V>(value)...);
+            }
+        });
+        state->trace_settled();
+        state->trigger_callbacks(std::move(callbacks));
+    }
+
+    void fail(std::exception_ptr error) {
+        auto state = std::move(_state);
+        auto callbacks = state->settle([&] {
+            state->state = PromiseState::REJECTED;
+            state->exception = std::move(error);
+        });
+        state->trace_settled();
+        state->trigger_callbacks(std::move(callbacks));
+    }
+
+private:
+    StatePtr<State, CoreExecutor> _state;
+};
+
+}
+
+// Runs fn on `core` and settles the returned promise back on the calling
+// core. Must be called from a CoreRuntime thread. If the runtime stops
+// before the round trip completes, the promise never settles, and its state
+// and continuations are freed with the runtime's queues.
+template<typename F>
+inline auto submit_to(std::size_t core, F fn) {
+    using R = std::invoke_result_t<F>;
+    using Trip = internal::RoundTrip<R>;
+
+    auto runtime = CoreRuntime::current();
+    assert(runtime && "submit_to called outside a CoreRuntime thread");
+    auto home = CoreRuntime::current_core();
+
+    auto state = internal::allocate_state<typename Trip::State>(CoreExecutor{});
+    state->start_trace();
+    auto promise = internal::adopt_state<R, CoreExecutor>(state);
+
+    // Tasks must be copyable; the trip is only ever moved along.
+    auto trip = std::make_shared<Trip>(std::move(state));
+    runtime->post(core, [runtime, home, fn = std::move(fn), trip = std::move(trip)]() mutable {
+        std::exception_ptr error;
+        if constexpr (std::is_void_v<R>) {
+            try {
+                fn();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            runtime->post(home, [trip = std::move(trip), error] {
+                if (error) {
+                    trip->fail(error);
+                } else {
+                    trip->fulfill();
+                }
+            });
+        } else {
+            std::optional<R> value;
+            try {
+                value.emplace(fn());
+            } catch (...) {
+                error = std::current_exception();
+            }
+            runtime->post(home, [trip = std::move(trip), value = std::move(value), error]() mutable {
+                if (error) {
+                    trip->fail(error);
+                } else {
+                    trip->fulfill(std::move(*value));
+                }
+            });
+        }
+    });
+    return promise;
+}
+
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "execution.hpp"
+#include "promise.hpp"
+
+namespace promise {
+
+namespace internal {
+
+// Shared state of a promise fed by a sender, with the connected operation
+// state stored inline: adopting a sender costs the one allocation any
+// promise needs.
+template<typename T, typename Executor, typename Sender>
+class SenderState : public SharedState<T, Executor> {
+public:
+    struct Receiver {
+        using receiver_concept = execution::receiver_t;
+
+        SenderState* state;
+
+        template<typename... V>
+        void set_value(V&&... value) && noexcept {
+            state->fulfill(std::forward<V>(value)...);
+        }
+
+        template<typename E>
+        void set_error(E&& error) && noexcept {
+            if constexpr (std::is_same_v<std::decay_t<E>, std::exception_ptr>) {
+                state->fail(std::forward<E>(error));
+            } else {
+                state->fail(std::make_exception_ptr(std::forward<E>(error)));
+            }
+        }
+
+        void set_stopped() && noexcept {
+            state->fail(std::make_exception_ptr(Cancelled()));
+        }
+
+        execution::empty_env get_env() const noexcept {
+            return {};
+        }
+    };
+
+    using Operation = decltype(std::declval<Sender>().connect(std::declval<Receiver>()));
+
+    SenderState(Executor executor) : SharedState<T, Executor>(std::move(executor)) {}
+
+    ~SenderState() {
+        if (_connected) {
+            operation().~Operation();
+        }
+    }
+
+    // The state owns itself until the sender completes.
+    void start(StatePtr<SenderState, Executor> self, Sender sender) {
+        new (&_storage) Operation(std::move(sender).connect(Receiver{this}));
+        _connected = true;
+        _self = std::move(self);
+        operation().start();
+    }
+
+private:
+    Operation& operation() {
+        return *std::launder(reinterpret_cast<Operation*>(&_storage));
+    }
+
+    template<typename... V>
+    void fulfill(V&&... value) {
+        if constexpr (std::is_void_v<T>) {
+            static_assert(sizeof...(V) == 0, "sender completes with a value, promise expects none");
+            settle(PromiseState::FULFILLED, nullptr);
+        } else {
+            static_assert(sizeof...(V) == 1, "sender must complete with exactly one value");
+            try {
+                ((this->value.emplace(std::forward<V>(value))), ...);
+            } catch (...) {
+                settle(PromiseState::REJECTED, std::current_exception());
+                return;
+            }
+            settle(PromiseState::FULFILLED, nullptr);
+        }
+    }
+
+    void fail(std::exception_ptr error) {
+        settle(PromiseState::REJECTED, std::move(error));
+    }
+
+    void settle(PromiseState state, std::exception_ptr error) {
+        auto callbacks = SharedState<T, Executor>::settle([&] {
+            this->state = state;
+            this->exception = std::move(error);
+        });
+        this->trace_settled();
+        this->trigger_callbacks(std::move(callbacks));
+
+        // May free this state; nothing below touches it.
+        auto self = std::move(_self);
+    }
+
+    alignas(Operation) unsigned char _storage[sizeof(Operation)];
+    bool _connected = false;
+    StatePtr<SenderState, Executor> _self;
+};
+
+template<typename Executor>
+inline constexpr bool executor_equality_comparable = std::is_invocable_r_v<bool, std::equal_to<>, const Executor&, const Executor&>;
+
+}
+
+// Starts sender right away and returns a promise for its result; the
+// promise's continuations run on executor. A stopped sender rejects with
+// promise::Cancelled.
+template<typename T, typename Sender, typename Executor>
+inline Promise<T, Executor> to_promise(Sender sender, Executor executor) {
+    using State = internal::SenderState<T, Executor, Sender>;
+
+    auto state = internal::allocate_state<State>(executor);
+    state->start_trace();
+    auto promise = internal::adopt_state<T, Executor>(state);
+    state->start(state, std::move(sender));
+    return promise;
+}
+
+// Exposes an executor as a scheduler: schedule() returns a sender that
+// completes on one of the executor's threads.
+template<typename Executor>
+class ExecutorScheduler {
+public:
+    using scheduler_concept = execution::scheduler_t;
+
+    template<typename Receiver>
+    class Operation {
+    public:
+        using operation_state_concept = execution::operation_state_t;
+
+        Operation(Executor executor, Receiver receiver)
+            : _executor(std::move(executor)), _receiver(std::move(receiver)) {}
+
+        Operation(const Operation&) = delete;
+        Operation& operator=(const Operation&) = delete;
+
+        void start() noexcept {
+            try {
+                _executor([this] {
+                    std::move(_receiver).set_value();
+                });
+            } catch (...) {
+                std::move(_receiver).set_error(std::current_exception());
+            }
+        }
+
+    private:
+        Executor _executor;
+        Receiver _receiver;
+    };
+
+    class Sender {
+    public:
+        using sender_concept = execution::sender_t;
+        using completion_signatures = execution::completion_signatures<
+            execution::set_value_t(),
+            execution::set_error_t(std::exception_ptr)
+        >;
+
+        explicit Sender(Executor executor) : _executor(std::move(executor)) {}
+
+        template<typename Receiver>
+        Operation<Receiver> connect(Receiver receiver) const {
+            return Operation<Receiver>(_executor, std::move(receiver));
+        }
+
+        execution::empty_env get_env() const noexcept {
+            return {};
+        }
+
+    private:
+        Executor _executor;
+    };
+
+    explicit ExecutorScheduler(Executor executor) : _executor(std::move(executor)) {}
+
+    Sender schedule() const {
+        return Sender(_executor);
+    }
+
+    bool operator==(const ExecutorScheduler& other) const {
+        if constexpr (internal::executor_equality_comparable<Executor>) {
+            return _executor == other._executor;
+        } else {
+            return true;
+        }
+    }
+
+    bool operator!=(const ExecutorScheduler& other) const {
+        return !(*this == other);
+    }
+
+private:
+    Executor _executor;
+};
+
+template<typename Executor>
+inline ExecutorScheduler<Executor> as_scheduler(Executor executor) {
+    return ExecutorScheduler<Executor>(std::move(executor));
+}
+
+}
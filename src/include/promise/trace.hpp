@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #include <intrin.h>
+    #define PROMISE_CC_HAS_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define PROMISE_CC_HAS_RDTSC 1
+#endif
+
+namespace promise {
+
+namespace trace {
+
+// Raw timestamp for hop records: TSC cycles on x86, steady clock
+// nanoseconds elsewhere. Only differences between ticks are meaningful.
+inline std::uint64_t ticks() noexcept {
+#if defined(PROMISE_CC_HAS_RDTSC)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+#endif
+}
+
+// Per-hop timestamps of one sampled chain. Every promise derived from a
+// sampled root through then() adds a hop; the trace is handed to the sink
+// once the last promise of the chain is gone.
+class Trace {
+public:
+    static constexpr std::size_t root = SIZE_MAX;
+
+    struct Hop {
+        std::size_t parent;
+        std::uint64_t created;
+        std::uint64_t started = 0;
+        std::uint64_t settled = 0;
+    };
+
+    ~Trace();
+
+    std::size_t open(std::size_t parent) {
+        auto now = ticks();
+        std::lock_guard<std::mutex> lock(_mtx);
+        _hops.push_back({parent, now});
+        return _hops.size() - 1;
+    }
+
+    void started(std::size_t hop) {
+        auto now = ticks();
+        std::lock_guard<std::mutex> lock(_mtx);
+        _hops[hop].started = now;
+    }
+
+    void settled(std::size_t hop) {
+        auto now = ticks();
+        std::lock_guard<std::mutex> lock(_mtx);
+        _hops[hop].settled = now;
+    }
+
+    std::vector<Hop> hops() const {
+        std::lock_guard<std::mutex> lock(_mtx);
+        return _hops;
+    }
+
+private:
+    mutable std::mutex _mtx;
+    std::vector<Hop> _hops;
+};
+
+using Sink = std::function<void(const Trace&)>;
+
+namespace internal {
+
+inline std::atomic<std::uint32_t>& sample_every() {
+    static std::atomic<std::uint32_t> every{0};
+    return every;
+}
+
+inline std::shared_ptr<Sink>& sink() {
+    static std::shared_ptr<Sink> sink;
+    return sink;
+}
+
+}
+
+// Trace one root chain in every `every`; 0 turns tracing off.
+inline void set_sample_rate(std::uint32_t every) {
+    internal::sample_every().store(every, std::memory_order_relaxed);
+}
+
+inline void set_sink(Sink sink) {
+    std::atomic_store(&internal::sink(), sink ? std::make_shared<Sink>(std::move(sink)) : nullptr);
+}
+
+// Called once per root promise; returns null for chains that are not sampled.
+inline std::shared_ptr<Trace> sample() {
+    auto every = internal::sample_every().load(std::memory_order_relaxed);
+    if (every == 0) {
+        return nullptr;
+    }
+
+    thread_local std::uint32_t counter = 0;
+    if (++counter < every) {
+        return nullptr;
+    }
+    counter = 0;
+
+    return std::make_shared<Trace>();
+}
+
+inline Trace::~Trace() {
+    if (auto sink = std::atomic_load(&internal::sink())) {
+        (*sink)(*this);
+    }
+}
+
+}
+
+}
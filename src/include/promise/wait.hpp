@@ -0,0 +1,285 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+#if defined(__linux__)
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+    #include <time.h>
+    #include <unistd.h>
+#else
+    #include <condition_variable>
+#endif
+
+#include "promise.hpp"
+
+namespace promise {
+
+namespace internal {
+
+// One-shot wakeup for a single blocked thread: a futex word on Linux, a
+// condition variable elsewhere.
+class Parker {
+public:
+    void park() {
+#if defined(__linux__)
+        while (_word.load(std::memory_order_acquire) == 0) {
+            ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&_word), FUTEX_WAIT_PRIVATE, 0, nullptr, nullptr, 0);
+        }
+#else
+        std::unique_lock<std::mutex> lock(_mtx);
+        _cv.wait(lock, [this] { return _word.load(std::memory_order_acquire) != 0; });
+#endif
+    }
+
+    // Returns early on unpark(); may also return spuriously.
+    void park_for(std::chrono::microseconds timeout) {
+#if defined(__linux__)
+        if (_word.load(std::memory_order_acquire) == 0) {
+            struct timespec ts;
+            ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000);
+            ts.tv_nsec = static_cast<long>(timeout.count() % 1000000 * 1000);
+            ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&_word), FUTEX_WAIT_PRIVATE, 0, &ts, nullptr, 0);
+        }
+#else
+        std::unique_lock<std::mutex> lock(_mtx);
+        _cv.wait_for(lock, timeout, [this] { return _word.load(std::memory_order_acquire) != 0; });
+#endif
+    }
+
+    bool ready() const {
+        return _word.load(std::memory_order_acquire) != 0;
+    }
+
+    void unpark() {
+#if defined(__linux__)
+        _word.store(1, std::memory_order_release);
+        ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&_word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+        std::lock_guard<std::mutex> lock(_mtx);
+        _word.store(1, std::memory_order_release);
+        _cv.notify_one();
+#endif
+    }
+
+private:
+    std::atomic<std::uint32_t> _word{0};
+#if !defined(__linux__)
+    std::mutex _mtx;
+    std::condition_variable _cv;
+#endif
+};
+
+struct Waiter {
+    static constexpr std::size_t none = std::numeric_limits<std::size_t>::max();
+
+    explicit Waiter(std::size_t count, bool any) : remaining(count), any(any) {}
+
+    // Nothing may touch the waiter after its count reaches zero.
+    void notify(std::size_t index) {
+        if (!any) {
+            if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                parker.unpark();
+            }
+            return;
+        }
+
+        auto expected = none;
+        if (first.compare_exchange_strong(expected, index, std::memory_order_acq_rel)) {
+            parker.unpark();
+        }
+        remaining.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    Parker parker;
+    std::atomic<std::size_t> remaining;
+    std::atomic<std::size_t> first{none};
+    const bool any;
+};
+
+template<typename Executor>
+struct WaitNode : Continuation<Executor> {
+    WaitNode() {
+        this->run_inline = true;
+    }
+
+    void run(ContinuationPtr<Executor>) override {
+        waiter->notify(index);
+    }
+
+    void cancel() override {
+        waiter->notify(index);
+    }
+
+    Waiter* waiter = nullptr;
+    std::size_t index = 0;
+};
+
+template<typename T, typename Executor>
+Executor promise_executor(const Promise<T, Executor>&);
+
+// Links one node per promise straight into its callback list, pointing at
+// a waiter on the caller's stack, and parks once.
+template<typename Range>
+class WaitGroup {
+public:
+    using Executor = decltype(promise_executor(*std::begin(std::declval<const Range&>())));
+
+    WaitGroup(const Range& promises, bool any)
+        : _promises(promises),
+          _count(static_cast<std::size_t>(std::distance(std::begin(promises), std::end(promises)))),
+          _nodes(new Node[_count]),
+          _waiter(_count, any) {
+        if constexpr (SharedStateBase<Executor>::lock_free) {
+            for (std::size_t i = 0; i < _count; ++i) {
+                _nodes[i] = state_handle<Executor>::template make<WaitNode<Executor>>(std::allocator<char>());
+            }
+        }
+    }
+
+    std::size_t run() {
+        std::size_t index = 0;
+        for (const auto& promise : _promises) {
+            if (_waiter.any && _waiter.first.load(std::memory_order_acquire) != Waiter::none) {
+                break;
+            }
+            link(*state_of(promise), index++);
+        }
+        _registered = index;
+        _waiter.remaining.fetch_sub(_count - _registered, std::memory_order_acq_rel);
+        block();
+
+        if (_waiter.any) {
+            unlink_rest();
+        }
+        return _waiter.first.load(std::memory_order_acquire);
+    }
+
+private:
+    // A pool thread that simply parked would shrink its pool, and deadlock
+    // it if what we wait for is queued behind us; so as long as the pool has
+    // work, run it. The timed park only bounds how late new work is noticed;
+    // settling still wakes us at once. Any other thread has nothing to help
+    // with and parks once.
+    void block() {
+        if constexpr (executor_helping<Executor>::value) {
+            const auto& executor = state_of(*std::begin(_promises))->executor;
+            if (executor.owns_current_thread()) {
+                auto idle = min_idle;
+                while (!_waiter.parker.ready()) {
+                    if (executor.help()) {
+                        idle = min_idle;
+                    } else {
+                        _waiter.parker.park_for(idle);
+                        idle = std::min(idle * 2, max_idle);
+                    }
+                }
+                return;
+            }
+        }
+        _waiter.parker.park();
+    }
+
+    static constexpr std::chrono::microseconds min_idle{50};
+    static constexpr std::chrono::microseconds max_idle{5000};
+
+    // A lock-free list keeps an unlinked node until its promise settles, so
+    // there every node has an owner of its own; a locked list lets go of it
+    // at once, and the nodes can live in one array.
+    using Node = std::conditional_t<SharedStateBase<Executor>::lock_free, StatePtr<WaitNode<Executor>, Executor>, WaitNode<Executor>>;
+
+    WaitNode<Executor>& node(std::size_t index) {
+        if constexpr (SharedStateBase<Executor>::lock_free) {
+            return *_nodes[index];
+        } else {
+            return _nodes[index];
+        }
+    }
+
+    ContinuationPtr<Executor> handle(std::size_t index) {
+        if constexpr (SharedStateBase<Executor>::lock_free) {
+            return _nodes[index];
+        } else {
+            return ContinuationPtr<Executor>(ContinuationPtr<Executor>(), static_cast<Continuation<Executor>*>(&_nodes[index]));
+        }
+    }
+
+    template<typename State>
+    void link(State& state, std::size_t index) {
+        auto& waiting = node(index);
+        waiting.waiter = &_waiter;
+        waiting.index = index;
+
+        auto callback = handle(index);
+        if (!state.link_callback(callback)) {
+            waiting.run(nullptr);
+        }
+    }
+
+    // Takes back the nodes of promises still pending, then waits out those
+    // a settling thread is already running.
+    void unlink_rest() {
+        std::size_t index = 0;
+        for (const auto& promise : _promises) {
+            if (index == _registered) {
+                break;
+            }
+            if (state_of(promise)->unlink_pending(node(index++))) {
+                _waiter.remaining.fetch_sub(1, std::memory_order_acq_rel);
+            }
+        }
+
+        while (_waiter.remaining.load(std::memory_order_acquire) != 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    const Range& _promises;
+    std::size_t _count;
+    std::unique_ptr<Node[]> _nodes;
+    std::size_t _registered = 0;
+    Waiter _waiter;
+};
+
+}
+
+// Blocks until every promise in the range has settled, fulfilled or
+// rejected. Settling threads wake the caller directly; no executor hop and
+// no helper thread is involved. On a thread of a built-in pool the caller
+// runs the pool's queued tasks while it waits.
+template<typename Range>
+inline void wait_all(const Range& promises) {
+    if (std::begin(promises) == std::end(promises)) {
+        return;
+    }
+    internal::WaitGroup<Range>(promises, false).run();
+}
+
+// Blocks until one promise in the range has settled and returns its index.
+template<typename Range>
+inline std::size_t wait_any(const Range& promises) {
+    if (std::begin(promises) == std::end(promises)) {
+        throw std::invalid_argument("wait_any() needs at least one promise");
+    }
+    return internal::WaitGroup<Range>(promises, true).run();
+}
+
+// Blocks until promise settles, helping its pool like wait_all().
+template<typename T, typename Executor>
+inline void wait(const Promise<T, Executor>& promise) {
+    wait_all(std::array<Promise<T, Executor>, 1>{promise});
+}
+
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "promise.hpp"
+
+namespace promise {
+
+// Holds the latest value of something many chains read (a config, a routing
+// table). get() is wait-free: one counter increment and one pointer load,
+// and no copy of the value. publish() swaps in a new value and never waits
+// for readers: replaced values are retired, and a later publish frees them
+// once every reader that could still see them is done, RCU style.
+// Publishes that arrive while another is in progress only replace what it
+// publishes next, so a burst of updates ends with the newest value and
+// nobody is told about the values in between. changed() settles at the next
+// publication with its version.
+template<typename T>
+class Watch {
+    struct Node {
+        T value;
+        std::uint64_t version;
+    };
+
+    static constexpr std::size_t slot_count = 32;
+
+    struct alignas(64) Slot {
+        std::atomic<std::size_t> readers[2] = {};
+    };
+
+public:
+    // Keeps the value it was taken from alive. Holding one does not block
+    // publish(), even on the same thread, but keeps every value replaced
+    // meanwhile in memory until it is released.
+    class Snapshot {
+    public:
+        Snapshot(Snapshot&& other) noexcept
+            : _slot(std::exchange(other._slot, nullptr)), _parity(other._parity), _node(other._node) {}
+
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+        Snapshot& operator=(Snapshot&&) = delete;
+
+        ~Snapshot() {
+            if (_slot) {
+                _slot->readers[_parity].fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        const T& operator*() const {
+            return _node->value;
+        }
+
+        const T* operator->() const {
+            return &_node->value;
+        }
+
+        std::uint64_t version() const {
+            return _node->version;
+        }
+
+    private:
+        friend class Watch;
+
+        Snapshot(Slot* slot, std::size_t parity, const Node* node) : _slot(slot), _parity(parity), _node(node) {}
+
+        Slot* _slot;
+        std::size_t _parity;
+        const Node* _node;
+    };
+
+    explicit Watch(T initial) : _current(new Node{std::move(initial), 0}) {}
+
+    Watch(const Watch&) = delete;
+    Watch& operator=(const Watch&) = delete;
+
+    // Pending changed() promises reject with promise::Cancelled. No
+    // snapshot may outlive the watch.
+    ~Watch() {
+        delete _current.load(std::memory_order_relaxed);
+        delete _pending;
+        for (auto batch : {&_retired, &_flipping, &_flipped}) {
+            for (auto node : *batch) {
+                delete node;
+            }
+        }
+
+        auto error = std::make_exception_ptr(Cancelled());
+        for (auto& waiter : _waiters) {
+            waiter.second(error);
+        }
+    }
+
+    Snapshot get() const {
+        auto& slot = _slots[slot_index()];
+        auto parity = _epoch.load(std::memory_order_seq_cst) & 1;
+        slot.readers[parity].fetch_add(1, std::memory_order_seq_cst);
+        return Snapshot(&slot, parity, _current.load(std::memory_order_seq_cst));
+    }
+
+    std::uint64_t version() const {
+        return _version.load(std::memory_order_acquire);
+    }
+
+    // Safe to call while holding a snapshot: `w.publish(update(*w.get()))`.
+    void publish(T value) {
+        auto node = new Node{std::move(value), 0};
+        {
+            std::lock_guard<std::mutex> lock(_publish_mtx);
+            std::swap(_pending, node);
+            if (_publishing) {
+                delete node;
+                return;
+            }
+            _publishing = true;
+        }
+
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(_publish_mtx);
+                node = std::exchange(_pending, nullptr);
+                if (!node) {
+                    _publishing = false;
+                    return;
+                }
+            }
+
+            node->version = _version.load(std::memory_order_relaxed) + 1;
+            auto old = _current.exchange(node, std::memory_order_seq_cst);
+            _version.store(node->version, std::memory_order_release);
+            notify(node->version);
+
+            _retired.push_back(old);
+            reclaim();
+        }
+    }
+
+    // Fulfilled with the version of the first publication after this call.
+    template<typename Executor>
+    Promise<std::uint64_t, Executor> changed(Executor executor) {
+        auto seen = version();
+        return usePromise<std::uint64_t>([this, seen](auto resolve, auto reject) {
+            std::unique_lock<std::mutex> lock(_waiters_mtx);
+            auto now = _version.load(std::memory_order_acquire);
+            if (now != seen) {
+                lock.unlock();
+                resolve(now);
+                return;
+            }
+            _waiters.emplace_back(resolve, reject);
+        }, std::move(executor));
+    }
+
+private:
+    static std::size_t slot_index() {
+        thread_local std::size_t index = std::hash<std::thread::id>()(std::this_thread::get_id()) % slot_count;
+        return index;
+    }
+
+    void notify(std::uint64_t version) {
+        std::vector<std::pair<std::function<void(std::uint64_t)>, std::function<void(std::exception_ptr)>>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(_waiters_mtx);
+            waiters.swap(_waiters);
+        }
+        for (auto& waiter : waiters) {
+            waiter.first(version);
+        }
+    }
+
+    // A reader may have read the epoch long before bumping its counter, so
+    // it can be counted under either parity: a node is free once two epoch
+    // flips made after it was retired have each seen their old parity
+    // drain. Never waits; whatever is still read stays for the next
+    // publish. Only the publishing thread gets here.
+    void reclaim() {
+        while (true) {
+            if (_flip_pending) {
+                if (!drained(_flip_parity)) {
+                    return;
+                }
+                _flip_pending = false;
+                for (auto node : _flipped) {
+                    delete node;
+                }
+                _flipped.swap(_flipping);
+                _flipping.clear();
+            }
+            if (_retired.empty() && _flipped.empty()) {
+                return;
+            }
+            _flipping.swap(_retired);
+            _flip_parity = _epoch.fetch_add(1, std::memory_order_seq_cst) & 1;
+            _flip_pending = true;
+        }
+    }
+
+    bool drained(std::size_t parity) const {
+        for (auto& slot : _slots) {
+            if (slot.readers[parity].load(std::memory_order_acquire) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    mutable std::array<Slot, slot_count> _slots;
+    alignas(64) std::atomic<std::size_t> _epoch{0};
+    std::atomic<Node*> _current;
+    std::atomic<std::uint64_t> _version{0};
+
+    std::mutex _publish_mtx;
+    Node* _pending = nullptr;
+    bool _publishing = false;
+
+    // Retired since the last flip, retired before the flip in progress, and
+    // waiting on one more flip.
+    std::vector<Node*> _retired;
+    std::vector<Node*> _flipping;
+    std::vector<Node*> _flipped;
+    std::size_t _flip_parity = 0;
+    bool _flip_pending = false;
+
+    std::mutex _waiters_mtx;
+    std::vector<std::pair<std::function<void(std::uint64_t)>, std::function<void(std::exception_ptr)>>> _waiters;
+};
+
+}
@@ -1,13 +1,45 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <exception>
+#include <fstream>
+#include <functional>
 #include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include <promise/promise.hpp>
+#include <promise/pool.hpp>
+#include <promise/queue.hpp>
+#include <promise/forkjoin.hpp>
+#include <promise/memo.hpp>
+#include <promise/wait.hpp>
+#include <promise/watch.hpp>
+#include <promise/keyed.hpp>
+#include <promise/sender.hpp>
+#include <promise/future.hpp>
+#include <promise/actor.hpp>
+#include <promise/combinators.hpp>
+#include <promise/executor.hpp>
+#include <promise/fs.hpp>
+#include <promise/profile.hpp>
+#include <promise/runtime.hpp>
 
 #include <catch2/catch_test_macros.hpp>
 
+#if defined(__linux__)
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
 #if __has_include(<spdlog/spdlog.h>)
     #include <spdlog/spdlog.h>
 #else
@@ -40,6 +72,25 @@ struct ExecutorAsync {
     }
 };
 
+struct ExecutorAligned : ExecutorSync {
+    using cache_aligned = std::true_type;
+};
+
+struct ExecutorPooled {
+    using allocator_type = promise::PoolAllocator<char>;
+
+    promise::FixedPool* pool;
+
+    allocator_type get_allocator() const {
+        return allocator_type(*pool);
+    }
+
+    template<typename F>
+    inline void operator()(F f) {
+        f();
+    }
+};
+
 TEST_CASE("Promise") {
     std::promise<int> p;
     auto f = p.get_future();
@@ -211,4 +262,1384 @@ TEST_CASE("is_promise") {
     );
     static_assert(promise::internal::is_promise_v<decltype(v)>);
     static_assert(!promise::internal::is_promise_v<int>);
+}
+
+struct ExecutorBudgeted : ExecutorSync {
+    promise::Budget* budget;
+
+    promise::Budget* get_budget() const {
+        return budget;
+    }
+};
+
+TEST_CASE("release consumed upstream value") {
+    std::function<void(int)> resolver;
+    std::weak_ptr<std::vector<int>> payload;
+    bool released = false;
+
+    usePromise<int>(
+        [&](auto resolve, auto reject) {
+            resolver = resolve;
+        },
+        ExecutorSync()
+    ).then([&](auto v) {
+        auto p = std::make_shared<std::vector<int>>(v);
+        payload = p;
+        return p;
+    }).then([&](const auto& p) {
+        return p->size();
+    }).then([&](auto v) {
+        released = payload.expired();
+        return true;
+    });
+
+    resolver(1024);
+
+    REQUIRE(released);
+
+    // The value is moved out only by its last owner: a parent with two
+    // continuations hands both an intact value.
+    struct Counted {
+        std::vector<int> data;
+        int* copies;
+
+        Counted(std::vector<int> data, int* copies) : data(std::move(data)), copies(copies) {}
+        Counted(const Counted& other) : data(other.data), copies(other.copies) { ++*copies; }
+        Counted(Counted&&) = default;
+        Counted& operator=(const Counted&) = delete;
+        Counted& operator=(Counted&&) = default;
+    };
+
+    int copies = 0;
+    std::function<void(Counted)> settle;
+    std::size_t intact = 0;
+    {
+        auto shared = usePromise<Counted>([&](auto resolve, auto) {
+            settle = resolve;
+        }, ExecutorSync());
+        shared.then([&](Counted c) { intact += c.data.size() == 3; });
+        shared.then([&](Counted c) { intact += c.data.size() == 3; });
+    }
+    settle(Counted({1, 2, 3}, &copies));
+    REQUIRE(intact == 2);
+    REQUIRE(copies >= 1);
+
+    // A value handed down a chain by its last owner is never copied.
+    copies = 0;
+    std::function<void(int)> start;
+    usePromise<int>([&](auto resolve, auto) {
+        start = resolve;
+    }, ExecutorSync()).then([&](int) {
+        return Counted({1, 2, 3}, &copies);
+    }).then([&](Counted c) { intact += c.data.size() == 3; });
+    start(0);
+    REQUIRE(intact == 3);
+    REQUIRE(copies == 0);
+}
+
+
+TEST_CASE("unsubscribe") {
+    std::function<void(int)> resolve_later;
+    auto source = usePromise<int>([&](auto resolve, auto reject) {
+        resolve_later = resolve;
+    }, ExecutorSync());
+
+    std::vector<int> seen;
+    auto [first, first_sub] = source.subscribe([&](int v) { seen.push_back(v); return 1; });
+    auto [second, second_sub] = source.subscribe([&](int v) { seen.push_back(v * 10); return 2; });
+    auto [third, third_sub] = source.subscribe([&](int v) { seen.push_back(v * 100); return 3; });
+
+    bool cancelled = false;
+    second.catch_err([&](std::exception_ptr e) {
+        try {
+            std::rethrow_exception(e);
+        } catch (const promise::Cancelled&) {
+            cancelled = true;
+        }
+        return 0;
+    });
+
+    REQUIRE(second_sub.cancel());
+    REQUIRE(cancelled);
+    REQUIRE_FALSE(second_sub.cancel());
+
+    resolve_later(1);
+    REQUIRE(seen == std::vector<int>{1, 100});
+    REQUIRE_FALSE(first_sub.cancel());
+    REQUIRE_FALSE(third_sub.cancel());
+}
+
+TEST_CASE("as_completed") {
+    std::vector<std::function<void(int)>> resolvers(3);
+    std::function<void(std::exception_ptr)> reject_last;
+    std::vector<promise::Promise<int, ExecutorSync>> inputs;
+    for (std::size_t i = 0; i < 3; ++i) {
+        inputs.push_back(usePromise<int>([&, i](auto resolve, auto reject) {
+            resolvers[i] = resolve;
+        }, ExecutorSync()));
+    }
+    inputs.push_back(usePromise<int>([&](auto resolve, auto reject) {
+        reject_last = reject;
+    }, ExecutorSync()));
+
+    auto stream = promise::as_completed(inputs);
+    REQUIRE(stream.size() == 4);
+
+    std::vector<std::size_t> order;
+    std::vector<int> values;
+    auto record = [&](promise::Completion<int> c) {
+        order.push_back(c.index);
+        values.push_back(c.value ? *c.value : -1);
+        return true;
+    };
+
+    // Waiting before anything settled, then reading what already has.
+    stream.next().then(record);
+    resolvers[2](20);
+    REQUIRE(order == std::vector<std::size_t>{2});
+
+    reject_last(std::make_exception_ptr(std::runtime_error("down")));
+    resolvers[0](0);
+    stream.next().then(record);
+    stream.next().then(record);
+    resolvers[1](10);
+    stream.next().then(record);
+
+    REQUIRE(order == std::vector<std::size_t>{2, 3, 0, 1});
+    REQUIRE(values == std::vector<int>{20, -1, 0, 10});
+    REQUIRE(stream.remaining() == 0);
+
+    bool exhausted = false;
+    stream.next().catch_err([&](std::exception_ptr) {
+        exhausted = true;
+        return promise::Completion<int>{};
+    });
+    REQUIRE(exhausted);
+}
+
+TEST_CASE("quorum") {
+    std::vector<std::function<void(int)>> resolvers(5);
+    std::vector<std::function<void(std::exception_ptr)>> rejecters(5);
+    std::vector<promise::Promise<int, ExecutorSync>> replicas;
+    for (std::size_t i = 0; i < 5; ++i) {
+        replicas.push_back(usePromise<int>([&, i](auto resolve, auto reject) {
+            resolvers[i] = resolve;
+            rejecters[i] = reject;
+        }, ExecutorSync()));
+    }
+
+    std::vector<int> values;
+    promise::quorum(replicas, 3).then([&](std::vector<int> v) {
+        values = std::move(v);
+        return true;
+    });
+
+    resolvers[4](4);
+    rejecters[0](std::make_exception_ptr(std::runtime_error("replica down")));
+    resolvers[1](1);
+    REQUIRE(values.empty());
+    resolvers[3](3);
+    REQUIRE(values == std::vector<int>{4, 1, 3});
+
+    // Rejects as soon as three successes are out of reach.
+    std::vector<promise::Promise<void, ExecutorSync>> writes;
+    std::vector<std::function<void(std::exception_ptr)>> failers(4);
+    for (std::size_t i = 0; i < 4; ++i) {
+        writes.push_back(usePromise<void>([&, i](auto resolve, auto reject) {
+            failers[i] = reject;
+        }, ExecutorSync()));
+    }
+
+    bool failed = false;
+    promise::quorum(writes, 3).then([] {}, [&](std::exception_ptr) {
+        failed = true;
+    });
+
+    failers[2](std::make_exception_ptr(std::runtime_error("timeout")));
+    REQUIRE_FALSE(failed);
+    failers[0](std::make_exception_ptr(std::runtime_error("timeout")));
+    REQUIRE(failed);
+}
+
+TEST_CASE("memory budget") {
+    promise::Budget global;
+    promise::Budget group(4096, promise::Budget::Overflow::reject, &global);
+    ExecutorBudgeted executor{{}, &group};
+
+    std::vector<promise::Promise<std::string, ExecutorBudgeted>> pending;
+    while (group.has_room()) {
+        pending.push_back(usePromise<std::string>([](auto resolve, auto reject) {}, executor));
+    }
+    REQUIRE(global.used() == group.used());
+
+    bool exceeded = false;
+    usePromise<std::string>([](auto resolve, auto reject) {
+        resolve("admitted");
+    }, executor).catch_err([&](std::exception_ptr e) {
+        try {
+            std::rethrow_exception(e);
+        } catch (const promise::BudgetExceeded&) {
+            exceeded = true;
+        }
+        return std::string();
+    });
+
+    REQUIRE(exceeded);
+
+    pending.clear();
+    REQUIRE(group.used() == 0);
+    REQUIRE(global.used() == 0);
+    REQUIRE(group.has_room());
+
+    // A pool thread waiting for room runs the queued work that frees it.
+    struct PoolBudgeted : promise::PoolExecutor {
+        promise::Budget* budget;
+
+        promise::Budget* get_budget() const {
+            return budget;
+        }
+    };
+
+    promise::ThreadPool pool(1);
+    promise::Budget waiting(std::numeric_limits<std::size_t>::max(), promise::Budget::Overflow::wait);
+    std::vector<promise::Promise<int, ExecutorBudgeted>> held;
+    for (int i = 0; i < 8; ++i) {
+        held.push_back(usePromise<int>([](auto resolve, auto reject) {
+            resolve(1);
+        }, ExecutorBudgeted{{}, &waiting}));
+    }
+    waiting.set_limit(waiting.used());
+
+    std::promise<void> admitted;
+    pool.post([&] {
+        pool.post([&] { held.clear(); });
+        usePromise<void>([](auto resolve, auto reject) {
+            resolve();
+        }, PoolBudgeted{{&pool}, &waiting});
+        admitted.set_value();
+    });
+    admitted.get_future().get();
+}
+
+TEST_CASE("pool allocator") {
+    REQUIRE_THROWS_AS(promise::FixedPool(0, 4), std::invalid_argument);
+    REQUIRE_THROWS_AS(promise::FixedPool(std::numeric_limits<std::size_t>::max() / 2, 4), std::bad_alloc);
+    REQUIRE_THROWS_AS(promise::FixedPool(64, std::numeric_limits<std::uint32_t>::max()), std::bad_alloc);
+
+    promise::FixedPool pool(256, 4);
+    std::function<void(int)> resolver;
+    int result = 0;
+
+    {
+        auto p = usePromise<int>(
+            [&](auto resolve, auto reject) {
+                resolver = resolve;
+            },
+            ExecutorPooled{&pool}
+        );
+
+        p.then([](auto v) {
+            return v * 2;
+        }).then([&](auto v) {
+            result = v;
+            return true;
+        });
+        REQUIRE(pool.used() == 3);
+
+        auto last = p.then([](auto v) {
+            return v;
+        });
+        REQUIRE_THROWS_AS(last.then([](auto v) { return v; }), std::bad_alloc);
+    }
+
+    resolver(21);
+    REQUIRE(result == 42);
+
+    resolver = nullptr;
+    REQUIRE(pool.used() == 0);
+
+    // Pooled states have lock-free callback lists: threads attach while
+    // another settles, and every continuation runs exactly once.
+    static_assert(promise::internal::lock_free_states<ExecutorPooled>::value, "pooled states are lock-free");
+    promise::FixedPool shared(256, 4096);
+    for (int round = 0; round < 20; ++round) {
+        std::function<void(int)> settle;
+        auto root = usePromise<int>([&](auto resolve, auto) {
+            settle = resolve;
+        }, ExecutorPooled{&shared});
+
+        std::atomic<int> ran{0};
+        std::vector<std::thread> attachers;
+        for (int t = 0; t < 4; ++t) {
+            attachers.emplace_back([&] {
+                for (int i = 0; i < 50; ++i) {
+                    root.then([&](int v) {
+                        ran += v;
+                    });
+                }
+            });
+        }
+        settle(1);
+        for (auto& attacher : attachers) {
+            attacher.join();
+        }
+        REQUIRE(ran == 200);
+    }
+
+    // An unsubscribed continuation stays linked but never runs, and is
+    // freed with its parent.
+    bool cancelled = false;
+    bool ran = false;
+    {
+        std::function<void(int)> settle;
+        auto root = usePromise<int>([&](auto resolve, auto) {
+            settle = resolve;
+        }, ExecutorPooled{&shared});
+        auto [next, subscription] = root.subscribe([&](int) {
+            ran = true;
+        });
+        next.then([] {}, [&](std::exception_ptr) {
+            cancelled = true;
+        });
+        REQUIRE(subscription.cancel());
+        REQUIRE(cancelled);
+        settle(1);
+        REQUIRE_FALSE(subscription.cancel());
+    }
+    REQUIRE_FALSE(ran);
+    REQUIRE(shared.used() == 0);
+
+    // wait_any() claims the nodes it leaves behind.
+    {
+        std::function<void(int)> first, second;
+        std::vector<promise::Promise<int, ExecutorPooled>> both{
+            usePromise<int>([&](auto resolve, auto) { first = resolve; }, ExecutorPooled{&shared}),
+            usePromise<int>([&](auto resolve, auto) { second = resolve; }, ExecutorPooled{&shared}),
+        };
+        std::thread([&] { second(2); }).join();
+        REQUIRE(promise::wait_any(both) == 1);
+        first(1);
+    }
+    REQUIRE(shared.used() == 0);
+}
+
+TEST_CASE("sampled trace") {
+    using promise::trace::Trace;
+
+    std::vector<Trace::Hop> hops;
+    promise::trace::set_sink([&](const Trace& trace) {
+        hops = trace.hops();
+    });
+    promise::trace::set_sample_rate(1);
+
+    useResolve<int>(
+        21,
+        ExecutorSync()
+    ).then([](auto v) {
+        return v * 2;
+    }).then([](auto v) {
+        return v == 42;
+    });
+
+    promise::trace::set_sample_rate(0);
+    promise::trace::set_sink(nullptr);
+
+    REQUIRE(hops.size() == 3);
+    REQUIRE(hops[0].parent == Trace::root);
+    REQUIRE(hops[1].parent == 0);
+    REQUIRE(hops[2].parent == 1);
+    REQUIRE(hops[2].started >= hops[1].settled);
+    REQUIRE(hops[2].settled >= hops[2].started);
+}
+
+
+TEST_CASE("lock profile") {
+    auto site = promise::CallSite::current();
+
+    promise::profile::ProfiledMutex mtx;
+    mtx.attach(site);
+    {
+        std::lock_guard<promise::profile::ProfiledMutex> lock(mtx);
+    }
+
+    auto reports = promise::profile::snapshot();
+    auto report = std::find_if(reports.begin(), reports.end(), [&](const auto& r) {
+        return r.site.line == site.line && std::string(r.site.file) == site.file;
+    });
+
+    REQUIRE(report != reports.end());
+    REQUIRE(report->acquisitions == 1);
+    REQUIRE(report->contended == 0);
+    REQUIRE(report->wait[0] == 1);
+
+#if defined(PROMISE_CC_PROFILE_LOCKS)
+    // Promise states report under the line that created them, every time.
+    unsigned line = 0;
+    for (int i = 0; i < 2; ++i) {
+        line = __LINE__ + 1;
+        usePromise<int>([](auto resolve, auto reject) { resolve(1); }, ExecutorSync()).then([](int) {});
+    }
+
+    reports = promise::profile::snapshot();
+    report = std::find_if(reports.begin(), reports.end(), [&](const auto& r) {
+        return r.site.line == line && std::string(r.site.file) == __FILE__;
+    });
+    REQUIRE(report != reports.end());
+    REQUIRE(report->acquisitions >= 2);
+#endif
+}
+
+TEST_CASE("submit_to") {
+    // Core-local states count their references without atomics.
+    static_assert(std::is_same_v<promise::internal::ContinuationPtr<promise::CoreExecutor>,
+        promise::internal::LocalPtr<promise::internal::Continuation<promise::CoreExecutor>>>);
+    promise::CoreRuntime runtime(2);
+
+    std::promise<std::pair<int, std::size_t>> p;
+    auto f = p.get_future();
+
+    runtime.post(0, [&] {
+        promise::submit_to(1, [] {
+            return static_cast<int>(promise::CoreRuntime::current_core()) + 41;
+        }).then([&](auto v) {
+            p.set_value({v, promise::CoreRuntime::current_core()});
+            return true;
+        });
+    });
+
+    auto [value, core] = f.get();
+    REQUIRE(value == 42);
+    REQUIRE(core == 0);
+
+    // Core-local handles also back subscriptions: cancelling detaches a
+    // pending continuation, and one outliving its promise does nothing.
+    struct ExecutorLocal : ExecutorSync {
+        using core_local = std::true_type;
+    };
+
+    std::function<void(int)> settle;
+    bool ran = false;
+    promise::Subscription<ExecutorLocal> stale;
+    {
+        auto root = usePromise<int>([&](auto resolve, auto) {
+            settle = resolve;
+        }, ExecutorLocal());
+        auto [next, subscription] = root.subscribe([&](int) {
+            ran = true;
+        });
+        REQUIRE(subscription.cancel());
+        stale = root.subscribe([](int) {}).second;
+        settle(1);
+    }
+    settle = nullptr;
+    REQUIRE_FALSE(ran);
+    REQUIRE_FALSE(stale.cancel());
+
+    // A round trip still queued when the runtime stops is freed with it.
+    auto tracker = std::make_shared<int>(0);
+    std::weak_ptr<int> watched = tracker;
+    {
+        promise::CoreRuntime stopping(2);
+        std::promise<void> busy, submitted;
+        stopping.post(1, [&] {
+            busy.set_value();
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        });
+        busy.get_future().get();
+        stopping.post(0, [&, tracker = std::move(tracker)] {
+            promise::submit_to(1, [] {
+                return 1;
+            }).then([tracker](int) {});
+            submitted.set_value();
+        });
+        submitted.get_future().get();
+        stopping.stop();
+    }
+    REQUIRE(watched.expired());
+}
+
+TEST_CASE("thread pool drain") {
+    promise::ThreadPool pool(4);
+    std::atomic<int> done{0};
+
+    for (int i = 0; i < 64; ++i) {
+        promise::usePromise<int>([i](auto resolve, auto reject) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            resolve(i);
+        }, pool.executor()).then([&](int) {
+            ++done;
+            return true;
+        });
+    }
+
+    std::promise<int> p;
+    auto f = p.get_future();
+    pool.drain().then([&] {
+        p.set_value(done.load());
+    });
+    REQUIRE(f.get() == 64);
+
+    // Anything still queued when the deadline passes is dropped.
+    promise::ThreadPool single(1);
+    std::atomic<int> ran{0};
+    std::promise<void> started;
+    single.post([&] {
+        started.set_value();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        ++ran;
+    });
+    for (int i = 0; i < 8; ++i) {
+        single.post([&] { ++ran; });
+    }
+
+    started.get_future().wait();
+    REQUIRE_FALSE(single.shutdown_for(std::chrono::milliseconds(5)));
+    REQUIRE(ran == 1);
+    REQUIRE(single.outstanding() == 0);
+
+    // A drain() still pending when shutdown gives up is cancelled.
+    promise::ThreadPool busy(2);
+    std::promise<void> busy_started;
+    busy.post([&] {
+        busy_started.set_value();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    });
+    busy_started.get_future().wait();
+
+    bool cancelled = false;
+    busy.drain().then([] {}, [&](std::exception_ptr error) {
+        try {
+            std::rethrow_exception(error);
+        } catch (const promise::Cancelled&) {
+            cancelled = true;
+        }
+    });
+    while (busy.outstanding() != 1) {
+        std::this_thread::yield();
+    }
+    REQUIRE_FALSE(busy.shutdown_for(std::chrono::milliseconds(5)));
+    REQUIRE(cancelled);
+}
+
+TEST_CASE("actor") {
+    struct Counter {
+        int value = 0;
+        bool overlapped = false;
+        std::atomic<int> inside{0};
+    };
+
+    promise::ThreadPool pool(4);
+    promise::Actor<std::shared_ptr<Counter>, promise::PoolExecutor> actor(std::make_shared<Counter>(), pool.executor(), 8);
+
+    std::vector<std::thread> senders;
+    for (int t = 0; t < 4; ++t) {
+        senders.emplace_back([&] {
+            for (int i = 0; i < 250; ++i) {
+                actor.tell([](std::shared_ptr<Counter>& counter) {
+                    counter->overlapped |= counter->inside.fetch_add(1) != 0;
+                    ++counter->value;
+                    counter->inside.fetch_sub(1);
+                });
+            }
+        });
+    }
+    for (auto& sender : senders) {
+        sender.join();
+    }
+
+    std::promise<int> p;
+    auto f = p.get_future();
+    actor.ask([](std::shared_ptr<Counter>& counter) {
+        return counter->overlapped ? -1 : counter->value;
+    }).then([&](int v) {
+        p.set_value(v);
+    });
+    REQUIRE(f.get() == 1000);
+
+    std::promise<bool> e;
+    auto rejected = e.get_future();
+    actor.ask([](std::shared_ptr<Counter>&) -> int {
+        throw std::runtime_error("nope");
+    }).then([&](int) {
+        e.set_value(false);
+    }, [&](std::exception_ptr) {
+        e.set_value(true);
+    });
+    REQUIRE(rejected.get());
+
+    // An ask() whose message is dropped unrun is cancelled, not lost.
+    struct ExecutorQueued {
+        std::vector<std::function<void()>>* tasks;
+
+        void operator()(std::function<void()> f) const {
+            tasks->push_back(std::move(f));
+        }
+    };
+
+    std::vector<std::function<void()>> tasks;
+    bool cancelled = false;
+    {
+        promise::Actor<int, ExecutorQueued> dropped(0, ExecutorQueued{&tasks});
+        dropped.ask([](int& v) { return v; }).then([](int) {}, [&](std::exception_ptr error) {
+            try {
+                std::rethrow_exception(error);
+            } catch (const promise::Cancelled&) {
+                cancelled = true;
+            }
+        });
+    }
+    // Run everything but the actor's drain, then drop the drain.
+    REQUIRE(tasks.size() >= 2);
+    auto drain = std::move(tasks.front());
+    tasks.erase(tasks.begin());
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+        auto task = std::move(tasks[i]);
+        task();
+    }
+    tasks.clear();
+    drain = nullptr;
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+        auto task = std::move(tasks[i]);
+        task();
+    }
+    REQUIRE(cancelled);
+}
+
+TEST_CASE("fromFuture") {
+    std::promise<int> legacy;
+    std::promise<int> result;
+    auto f = result.get_future();
+
+    promise::fromFuture(legacy.get_future(), ExecutorSync()).then([&](int v) {
+        result.set_value(v);
+    });
+
+    std::thread producer([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        legacy.set_value(7);
+    });
+    REQUIRE(f.get() == 7);
+    producer.join();
+
+    std::promise<void> failing;
+    auto shared = failing.get_future().share();
+    failing.set_exception(std::make_exception_ptr(std::runtime_error("legacy failure")));
+
+    bool rejected = false;
+    promise::fromFuture(shared, ExecutorSync()).then([] {}, [&](std::exception_ptr) {
+        rejected = true;
+    });
+    REQUIRE(rejected);
+
+    auto deferred = std::async(std::launch::deferred, [] { return 3; });
+    int value = 0;
+    promise::fromFuture(std::move(deferred), ExecutorSync()).then([&](int v) {
+        value = v;
+    });
+    REQUIRE(value == 3);
+}
+
+template<typename T>
+struct JustSender {
+    using sender_concept = promise::execution::sender_t;
+
+    T value;
+
+    template<typename Receiver>
+    struct Operation {
+        T value;
+        Receiver receiver;
+
+        void start() noexcept {
+            std::move(receiver).set_value(std::move(value));
+        }
+    };
+
+    template<typename Receiver>
+    Operation<Receiver> connect(Receiver receiver) && {
+        return {std::move(value), std::move(receiver)};
+    }
+};
+
+template<typename T>
+struct CaptureReceiver {
+    using receiver_concept = promise::execution::receiver_t;
+
+    std::promise<T>* result;
+
+    void set_value(T value) && noexcept {
+        result->set_value(std::move(value));
+    }
+
+    void set_error(std::exception_ptr e) && noexcept {
+        result->set_exception(e);
+    }
+
+    void set_stopped() && noexcept {}
+};
+
+TEST_CASE("sender interop") {
+    // Sender into promise.
+    int value = 0;
+    promise::to_promise<int>(JustSender<int>{41}, ExecutorSync()).then([&](int v) {
+        value = v + 1;
+    });
+    REQUIRE(value == 42);
+
+    // Promise as sender.
+    std::function<void(std::string)> resolve_later;
+    auto source = usePromise<std::string>([&](auto resolve, auto reject) {
+        resolve_later = resolve;
+    }, ExecutorSync());
+
+    std::promise<std::string> result;
+    auto f = result.get_future();
+    auto operation = source.connect(CaptureReceiver<std::string>{&result});
+    operation.start();
+    resolve_later("sent");
+    REQUIRE(f.get() == "sent");
+
+    // Executor as scheduler.
+    promise::ThreadPool pool(1);
+    auto scheduler = promise::as_scheduler(pool.executor());
+    REQUIRE(scheduler == promise::as_scheduler(pool.executor()));
+
+    std::promise<bool> on_pool;
+    auto scheduled = on_pool.get_future();
+    auto caller = std::this_thread::get_id();
+    promise::to_promise<void>(scheduler.schedule(), pool.executor()).then([&] {
+        on_pool.set_value(std::this_thread::get_id() != caller);
+    });
+    REQUIRE(scheduled.get());
+}
+
+TEST_CASE("async priority queue") {
+    promise::AsyncPriorityQueue<int> strict(1);
+    strict.push(1);
+    strict.push(5);
+    strict.push(3);
+
+    std::vector<int> order;
+    for (int i = 0; i < 3; ++i) {
+        strict.pop(ExecutorSync()).then([&](int v) {
+            order.push_back(v);
+        });
+    }
+    REQUIRE(order == std::vector<int>{5, 3, 1});
+
+    // A waiting pop is completed by the push itself.
+    int received = 0;
+    strict.pop(ExecutorSync()).then([&](int v) {
+        received = v;
+    });
+    REQUIRE(strict.size() == -1);
+    strict.push(9);
+    REQUIRE(received == 9);
+    REQUIRE_FALSE(strict.try_pop());
+
+    // Pops still waiting when the queue goes away are cancelled.
+    auto doomed = std::make_unique<promise::AsyncPriorityQueue<int>>(1);
+    bool cancelled = false;
+    doomed->pop(ExecutorSync()).then([](int) {}, [&](std::exception_ptr error) {
+        try {
+            std::rethrow_exception(error);
+        } catch (const promise::Cancelled&) {
+            cancelled = true;
+        }
+    });
+    doomed.reset();
+    REQUIRE(cancelled);
+
+    promise::ThreadPool pool(4);
+    promise::AsyncPriorityQueue<int> relaxed(4);
+    std::atomic<long> sum{0};
+    std::atomic<int> popped{0};
+    std::promise<void> done;
+
+    for (int i = 0; i < 2000; ++i) {
+        relaxed.pop(pool.executor()).then([&](int v) {
+            sum += v;
+            if (++popped == 2000) {
+                done.set_value();
+            }
+        });
+    }
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; ++t) {
+        producers.emplace_back([&, t] {
+            for (int i = 1; i <= 500; ++i) {
+                relaxed.push(t * 500 + i);
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    done.get_future().get();
+    REQUIRE(sum == 2000L * 2001 / 2);
+    REQUIRE(relaxed.size() == 0);
+}
+
+TEST_CASE("cache aligned state") {
+    using State = promise::internal::SharedState<int, ExecutorAligned>;
+    constexpr auto line = promise::internal::cache_line_size;
+    static_assert(alignof(State) == line);
+
+    auto state = std::make_shared<State>(ExecutorAligned());
+    auto base = reinterpret_cast<std::uintptr_t>(state.get());
+    auto value = reinterpret_cast<std::uintptr_t>(&state->value);
+    REQUIRE(base % line == 0);
+    REQUIRE(value % line == 0);
+    REQUIRE(value - base >= line);
+
+    int result = 0;
+    useResolve<int>(
+        21,
+        ExecutorAligned()
+    ).then([&](auto v) {
+        result = v * 2;
+        return true;
+    });
+    REQUIRE(result == 42);
+}
+
+#if defined(__linux__)
+TEST_CASE("fs walk") {
+    char root[] = "/tmp/promise-cc-walk-XXXXXX";
+    REQUIRE(mkdtemp(root) != nullptr);
+
+    std::vector<std::string> dirs = {"a", "a/b", "a/b/c", "d"};
+    for (const auto& dir : dirs) {
+        REQUIRE(mkdir((std::string(root) + "/" + dir).c_str(), 0700) == 0);
+    }
+    for (const auto& dir : dirs) {
+        for (int i = 0; i < 10; ++i) {
+            std::ofstream(std::string(root) + "/" + dir + "/f" + std::to_string(i));
+        }
+    }
+    // Reported, but neither files nor directories to descend into.
+    REQUIRE(mkfifo((std::string(root) + "/d/pipe").c_str(), 0600) == 0);
+    REQUIRE(symlink("../a", (std::string(root) + "/d/link").c_str()) == 0);
+
+    std::mutex mtx;
+    std::vector<std::string> seen;
+    std::promise<promise::fs::WalkStats> p;
+    auto f = p.get_future();
+
+    promise::fs::WalkOptions options;
+    options.max_concurrency = 4;
+    options.batch_size = 8;
+
+    promise::fs::walk(root, [&](const std::vector<promise::fs::Entry>& batch) {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (const auto& entry : batch) {
+            seen.push_back(entry.path);
+        }
+    }, ExecutorAsync(), options).then([&](auto stats) {
+        p.set_value(stats);
+        return true;
+    });
+
+    auto stats = f.get();
+    REQUIRE(stats.directories == 4);
+    REQUIRE(stats.files == 40);
+    REQUIRE(stats.errors == 0);
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        REQUIRE(seen.size() == 46);
+        REQUIRE(std::find(seen.begin(), seen.end(), std::string(root) + "/a/b/c/f9") != seen.end());
+    }
+
+    // Without spare fds every subdirectory is reopened by path.
+    options.max_open_dirs = 0;
+    std::promise<promise::fs::WalkStats> reopened;
+    promise::fs::walk(root, [](const std::vector<promise::fs::Entry>&) {}, ExecutorAsync(), options).then([&](auto stats) {
+        reopened.set_value(stats);
+        return true;
+    });
+    stats = reopened.get_future().get();
+    REQUIRE(stats.directories == 4);
+    REQUIRE(stats.files == 40);
+    REQUIRE(stats.errors == 0);
+
+    std::system((std::string("rm -rf ") + root).c_str());
+}
+#endif
+
+static long fib(promise::ForkJoinPool& pool, int n) {
+    if (n < 2) {
+        return n;
+    }
+    auto left = pool.spawn([&pool, n] { return fib(pool, n - 1); });
+    auto right = fib(pool, n - 2);
+    return left.sync() + right;
+}
+
+TEST_CASE("fork join") {
+    promise::ForkJoinPool pool(4);
+
+    std::promise<long> result;
+    promise::fork_join(pool, [](promise::ForkJoinPool& pool) {
+        return fib(pool, 22);
+    }, ExecutorSync()).then([&](long v) {
+        result.set_value(v);
+    });
+    REQUIRE(result.get_future().get() == 17711);
+
+    // A child's exception surfaces at sync() and rejects the promise.
+    std::promise<bool> rejected;
+    promise::fork_join(pool, [](promise::ForkJoinPool& pool) {
+        auto child = pool.spawn([] {
+            throw std::runtime_error("child");
+        });
+        child.sync();
+    }, ExecutorSync()).then([&] {
+        rejected.set_value(false);
+    }, [&](std::exception_ptr) {
+        rejected.set_value(true);
+    });
+    REQUIRE(rejected.get_future().get());
+
+    // Syncing out of LIFO order on a lone worker must still find the child.
+    promise::ForkJoinPool single(1);
+    std::promise<int> unordered;
+    promise::fork_join(single, [](promise::ForkJoinPool& pool) {
+        auto a = pool.spawn([] { return 1; });
+        auto b = pool.spawn([] { return 2; });
+        auto first = a.sync();
+        return first * 10 + b.sync();
+    }, ExecutorSync()).then([&](int v) {
+        unordered.set_value(v);
+    });
+    REQUIRE(unordered.get_future().get() == 12);
+
+    // Idle workers park until woken; spawned children must still reach them.
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::promise<bool> together;
+    promise::fork_join(pool, [](promise::ForkJoinPool& pool) {
+        std::atomic<int> running{0};
+        auto meet = [&running] {
+            running.fetch_add(1);
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+            while (running.load() < 3 && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::yield();
+            }
+            return running.load() >= 3;
+        };
+        auto a = pool.spawn(meet);
+        auto b = pool.spawn(meet);
+        auto c = pool.spawn(meet);
+        bool met = c.sync();
+        met = b.sync() && met;
+        return a.sync() && met;
+    }, ExecutorSync()).then([&](bool met) {
+        together.set_value(met);
+    });
+    REQUIRE(together.get_future().get());
+}
+
+#if defined(__linux__)
+TEST_CASE("disk memo") {
+    char dir[] = "/tmp/promise-cc-memo-XXXXXX";
+    REQUIRE(mkdtemp(dir) != nullptr);
+    auto path = std::string(dir) + "/memo";
+
+    int calls = 0;
+    auto compute = [&] {
+        ++calls;
+        return 42;
+    };
+
+    {
+        promise::DiskMemo<int, ExecutorSync> memo(path);
+        int first = 0;
+        memo.get("answer", compute).then([&](int v) {
+            first = v;
+        });
+        REQUIRE(first == 42);
+
+        // Concurrent lookups share one factory run.
+        std::vector<int> values;
+        std::function<void(int)> resolve_slow;
+        auto pending = [&] {
+            ++calls;
+            return promise::usePromise<int>([&](auto resolve, auto) {
+                resolve_slow = resolve;
+            }, ExecutorSync());
+        };
+        for (int i = 0; i < 3; ++i) {
+            memo.get("slow", pending).then([&](int v) {
+                values.push_back(v);
+            });
+        }
+        REQUIRE(calls == 2);
+        REQUIRE(values.empty());
+        resolve_slow(7);
+        REQUIRE(values == std::vector<int>{7, 7, 7});
+
+        memo.get("answer", compute);
+        REQUIRE(calls == 2);
+        REQUIRE(memo.size() == 2);
+    }
+
+    // A torn record at the tail is dropped on the next open.
+    {
+        std::ofstream(path, std::ios::binary | std::ios::app) << "torn";
+    }
+
+    promise::DiskMemo<std::string, ExecutorSync> strings(path + ".str");
+    std::string text;
+    strings.get("k", [] {
+        return std::string("value");
+    }).then([&](std::string v) {
+        text = v;
+    });
+    REQUIRE(text == "value");
+
+    // Records spanning many pages stay readable as the mapping grows.
+    for (int i = 0; i < 500; ++i) {
+        strings.get("k" + std::to_string(i), [i] {
+            return std::string(100, static_cast<char>('a' + i % 26));
+        });
+    }
+    int intact = 0;
+    for (int i = 0; i < 500; ++i) {
+        strings.get("k" + std::to_string(i), [] {
+            return std::string();
+        }).then([&, i](std::string v) {
+            intact += v == std::string(100, static_cast<char>('a' + i % 26));
+        });
+    }
+    REQUIRE(intact == 500);
+
+    promise::DiskMemo<int, ExecutorSync> reopened(path);
+    REQUIRE(reopened.size() == 2);
+    int answer = 0;
+    int slow = 0;
+    reopened.get("answer", compute).then([&](int v) {
+        answer = v;
+    });
+    reopened.get("slow", compute).then([&](int v) {
+        slow = v;
+    });
+    REQUIRE(answer == 42);
+    REQUIRE(slow == 7);
+    REQUIRE(calls == 2);
+
+    std::remove(path.c_str());
+    std::remove((path + ".str").c_str());
+    rmdir(dir);
+}
+#endif
+
+TEST_CASE("wait all and any") {
+    using IntPromise = promise::Promise<int, ExecutorSync>;
+
+    std::vector<std::function<void(int)>> resolvers(4);
+    std::vector<IntPromise> promises;
+    for (auto& resolver : resolvers) {
+        promises.push_back(usePromise<int>([&resolver](auto resolve, auto) {
+            resolver = resolve;
+        }, ExecutorSync()));
+    }
+
+    std::atomic<int> settled{0};
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < resolvers.size(); ++i) {
+        threads.emplace_back([&, i] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2 * i));
+            ++settled;
+            resolvers[i](int(i));
+        });
+    }
+    promise::wait_all(promises);
+    REQUIRE(settled == 4);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // Rejected counts as settled; already settled promises return at once.
+    std::vector<IntPromise> ready = {
+        IntPromise::reject(std::runtime_error("no"), ExecutorSync()),
+        IntPromise::resolve(1, ExecutorSync()),
+    };
+    promise::wait_all(ready);
+    REQUIRE(promise::wait_any(ready) == 0);
+
+    std::vector<std::function<void(int)>> later(3);
+    std::vector<IntPromise> pending;
+    for (auto& resolver : later) {
+        pending.push_back(usePromise<int>([&resolver](auto resolve, auto) {
+            resolver = resolve;
+        }, ExecutorSync()));
+    }
+    std::thread second([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        later[1](1);
+    });
+    REQUIRE(promise::wait_any(pending) == 1);
+    second.join();
+
+    // The waiter is gone; settling the rest must not touch it.
+    later[0](0);
+    later[2](2);
+    REQUIRE_THROWS_AS(promise::wait_any(std::vector<IntPromise>()), std::invalid_argument);
+}
+
+TEST_CASE("work-helping wait") {
+    // With one worker, the continuation the task waits for is queued behind
+    // the task itself: a plain block would never return.
+    promise::ThreadPool pool(1);
+    std::promise<int> out;
+    pool.post([&] {
+        auto doubled = usePromise<int>([](auto resolve, auto) {
+            resolve(21);
+        }, pool.executor()).then([](int v) {
+            return v * 2;
+        });
+        promise::wait(doubled);
+        doubled.then([&](int v) {
+            out.set_value(v);
+        });
+    });
+    REQUIRE(out.get_future().get() == 42);
+
+    // A core waiting on its own promise keeps running the core.
+    promise::CoreRuntime runtime(2);
+    std::promise<int> on_core;
+    runtime.post(0, [&] {
+        auto remote = promise::submit_to(1, [] {
+            return 7;
+        });
+        promise::wait(remote);
+        remote.then([&](int v) {
+            on_core.set_value(v);
+        });
+    });
+    REQUIRE(on_core.get_future().get() == 7);
+
+    // A thread outside the pool has nothing to help with and just parks.
+    struct ExecutorCounting : ExecutorAsync {
+        std::atomic<int>* helped;
+
+        bool help() const {
+            helped->fetch_add(1);
+            return false;
+        }
+
+        bool owns_current_thread() const {
+            return false;
+        }
+    };
+    std::atomic<int> helped{0};
+    auto late = usePromise<int>([](auto resolve, auto) {
+        std::thread([resolve] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            resolve(1);
+        }).detach();
+    }, ExecutorCounting{{}, &helped});
+    promise::wait(late);
+    REQUIRE(helped.load() == 0);
+    REQUIRE_FALSE(pool.executor().owns_current_thread());
+}
+
+TEST_CASE("watch") {
+    promise::Watch<std::string> config("v0");
+    REQUIRE(*config.get() == "v0");
+    REQUIRE(config.get().version() == 0);
+
+    std::uint64_t seen = 0;
+    config.changed(ExecutorSync()).then([&](std::uint64_t version) {
+        seen = version;
+    });
+    config.publish("v1");
+    REQUIRE(seen == 1);
+    REQUIRE(*config.get() == "v1");
+
+    // Publishes arriving while another is in progress are folded into it.
+    config.changed(ExecutorSync()).then([&](std::uint64_t) {
+        config.publish("v3");
+        config.publish("v4");
+    });
+    config.publish("v2");
+    REQUIRE(config.version() == 3);
+    REQUIRE(*config.get() == "v4");
+
+    // Publishing while holding a snapshot neither blocks nor frees it.
+    {
+        auto reader = config.get();
+        config.publish(*reader + "+");
+        config.publish(*reader + "++");
+        REQUIRE(*reader == "v4");
+    }
+    config.publish("v5");
+    REQUIRE(*config.get() == "v5");
+
+    promise::Watch<std::vector<int>> table(std::vector<int>(64, 0));
+    std::atomic<bool> stop{false};
+    std::atomic<int> torn{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&] {
+            while (!stop) {
+                auto snapshot = table.get();
+                if (std::count(snapshot->begin(), snapshot->end(), snapshot->front()) != 64) {
+                    ++torn;
+                }
+            }
+        });
+    }
+    for (int i = 1; i <= 200; ++i) {
+        table.publish(std::vector<int>(64, i));
+    }
+    stop = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    REQUIRE(torn == 0);
+    REQUIRE(table.get()->front() == 200);
+}
+
+TEST_CASE("keyed lanes") {
+    promise::ThreadPool pool(4);
+    promise::KeyedLanes<promise::PoolExecutor> lanes(pool.executor(), 8);
+
+    constexpr int keys = 16;
+    constexpr int per_key = 50;
+    std::vector<std::vector<int>> order(keys);
+    std::vector<std::atomic<bool>> busy(keys);
+    std::atomic<int> overlaps{0};
+    std::atomic<int> remaining{2 * keys * per_key};
+    std::promise<void> done;
+
+    auto enter = [&](int key) {
+        if (busy[key].exchange(true)) {
+            ++overlaps;
+        }
+    };
+    auto leave = [&](int key) {
+        busy[key] = false;
+        if (--remaining == 0) {
+            done.set_value();
+        }
+    };
+
+    for (int i = 0; i < per_key; ++i) {
+        for (int key = 0; key < keys; ++key) {
+            auto executor = lanes.executor(key);
+            executor([&, key, i] {
+                enter(key);
+                order[key].push_back(i);
+                leave(key);
+            });
+
+            // Continuations inherit the key from the promise they follow.
+            usePromise<int>([i](auto resolve, auto) {
+                resolve(i);
+            }, executor).then([&, key](int) {
+                enter(key);
+                leave(key);
+            });
+        }
+    }
+
+    done.get_future().get();
+    REQUIRE(overlaps == 0);
+    for (auto& log : order) {
+        REQUIRE(log.size() == per_key);
+        REQUIRE(std::is_sorted(log.begin(), log.end()));
+    }
+    REQUIRE(lanes.executor(3) == lanes.executor(3));
+
+    // A chain keeps its lane alive after the KeyedLanes is gone.
+    std::promise<int> outlived;
+    {
+        promise::KeyedLanes<promise::PoolExecutor> scoped(pool.executor(), 2);
+        usePromise<int>([](auto resolve, auto) {
+            resolve(1);
+        }, scoped.executor(7)).then([](int v) {
+            return v + 1;
+        }).then([&](int v) {
+            outlived.set_value(v);
+        });
+    }
+    REQUIRE(outlived.get_future().get() == 2);
+
+    // A lane task waiting on another lane helps the pool under both.
+    promise::ThreadPool single(1);
+    promise::KeyedLanes<promise::PoolExecutor> narrow(single.executor(), 2);
+    int far = 1;
+    while (narrow.executor(far) == narrow.executor(0)) {
+        ++far;
+    }
+    std::promise<int> helped;
+    narrow.executor(0)([&] {
+        auto other = usePromise<int>([](auto resolve, auto) {
+            resolve(20);
+        }, narrow.executor(far)).then([](int v) {
+            return v + 1;
+        });
+        promise::wait(other);
+        other.then([&](int v) {
+            helped.set_value(v);
+        });
+    });
+    REQUIRE(helped.get_future().get() == 21);
+}
+
+TEST_CASE("cpu accounting") {
+    constexpr std::uint64_t ms = 1000000;
+    auto burn = [](std::uint64_t amount) {
+        auto until = promise::cost::now(promise::cost::Clock::thread_cpu) + amount * ms;
+        while (promise::cost::now(promise::cost::Clock::thread_cpu) < until) {
+        }
+    };
+
+    promise::ThreadPool pool(2);
+    auto account = std::make_shared<promise::cost::Account>();
+    std::promise<bool> inherited;
+    {
+        promise::cost::Scope scope(account);
+        usePromise<int>([&](auto resolve, auto) {
+            burn(10);
+            resolve(1);
+        }, pool.executor()).then([&](int v) {
+            burn(10);
+            return v;
+        }).then([&](int) {
+            inherited.set_value(promise::cost::current() == account);
+        });
+    }
+    REQUIRE(promise::cost::current() == nullptr);
+
+    // Not billed: created outside the scope.
+    usePromise<int>([&](auto resolve, auto) {
+        burn(10);
+        resolve(0);
+    }, pool.executor());
+
+    REQUIRE(inherited.get_future().get());
+    while (account->runs() < 3) {
+        std::this_thread::yield();
+    }
+    REQUIRE(account->total() >= 20 * ms);
+    REQUIRE(account->total() < 29 * ms);
+
+    // Continuations run inline are not billed twice.
+    auto inline_account = std::make_shared<promise::cost::Account>();
+    {
+        promise::cost::Scope scope(inline_account);
+        usePromise<int>([&](auto resolve, auto) {
+            burn(10);
+            resolve(1);
+        }, ExecutorSync()).then([&](int) {
+            burn(10);
+        });
+    }
+    REQUIRE(inline_account->runs() == 2);
+    REQUIRE(inline_account->total() >= 20 * ms);
+    REQUIRE(inline_account->total() < 28 * ms);
 }
\ No newline at end of file